@@ -14,9 +14,13 @@ CXX 		?=
 CXXFLAGS 	:= -Wall -Werror -std=c++11 -pthread
 DBGFLAGS 	:= -g -ggdb
 TESTFLAGS 	:= -fprofile-arcs -ftest-coverage --coverage
+TRACEFLAGS 	:= -DCOMMUNICATION_MANAGER_TRACE
+RELEASEFLAGS 	:= -O2
 LINKFLAGS 	:= -shared
 
 COBJFLAGS 	:= $(CXXFLAGS) -c -fPIC
 test: COBJFLAGS 	+= $(TESTFLAGS)
 test: LINKFLAGS 	+= -fprofile-arcs -lgcov
 debug: COBJFLAGS 	+= $(DBGFLAGS)
+trace: COBJFLAGS 	+= $(TRACEFLAGS)
+release: COBJFLAGS 	+= $(RELEASEFLAGS)
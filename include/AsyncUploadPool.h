@@ -0,0 +1,135 @@
+#ifndef ASYNC_UPLOAD_POOL_H
+#define ASYNC_UPLOAD_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Optional pool of threads shared by the asynchronous uploads of all
+ *        handlers. Operations are queued and run in order by the first free
+ *        worker. Operations waiting for a retry stay in the queue until
+ *        their retry time, or until they're cancelled, without holding a
+ *        worker. Completion of the worker is tracked under the pool lock,
+ *        which outlives the operations, so an operation can be released as
+ *        soon as it's done.
+ *
+ *        Resizing never waits for the queue: extra workers retire on their
+ *        own once they're done with their current operation, and the last
+ *        one only after the queue is empty. Retired threads are joined by
+ *        the next resize.
+ *
+ *        The pool is destroyed on process exit, after singletons the
+ *        operations use may be gone, so queued operations are abandoned
+ *        instead of run. Only the steps already running are waited for.
+ */
+class AsyncUploadPool
+{
+public:
+    /**
+     * @brief An operation run by the pool, one step at a time.
+     */
+    class Operation
+    {
+    public:
+        virtual ~Operation() {}
+
+        /**
+         * @brief Run the next step of the operation.
+         *
+         * @param[out] retryAt the time to run the next step at, if the
+         *                     operation isn't finished.
+         *
+         * @return true if the operation finished, false to queue it again.
+         */
+        virtual bool step(std::chrono::steady_clock::time_point *retryAt) = 0;
+
+        /**
+         * @brief Tell whether the operation was cancelled, so its next step
+         *        must run without waiting for its retry time. Called with the
+         *        pool lock held, so it must not block.
+         *
+         * @return true if the operation was cancelled.
+         */
+        virtual bool isCancelled() = 0;
+
+        /**
+         * @brief Finish the operation as failed without running its next
+         *        step, when the pool is destroyed with the operation queued.
+         */
+        virtual void abandon() = 0;
+
+    private:
+        friend class AsyncUploadPool;
+
+        bool queued = false;
+        std::chrono::steady_clock::time_point retryAt;
+    };
+
+    AsyncUploadPool() = default;
+    ~AsyncUploadPool();
+
+    /**
+     * @brief Set the number of workers. 0 stops the pool once its queue is
+     *        empty. Doesn't wait for the running operations.
+     *
+     * @param[in] workers the number of workers.
+     */
+    void setWorkers(unsigned int workers);
+
+    /**
+     * @brief Queue an operation.
+     *
+     * @param[in] operation the operation.
+     *
+     * @return true if success, false if the pool has no workers.
+     */
+    bool submit(Operation *operation);
+
+    /**
+     * @brief Wait until the pool is done with an operation. Returns at once
+     *        for operations that weren't submitted.
+     *
+     * @param[in] operation the operation.
+     */
+    void wait(Operation *operation);
+
+    /**
+     * @brief Get the number of queued operations, including the ones waiting
+     *        for a retry.
+     *
+     * @return the number of operations.
+     */
+    size_t queued();
+
+    /**
+     * @brief Make the workers check the queue again, e.g. after an
+     *        operation was cancelled.
+     */
+    void wake();
+
+private:
+    AsyncUploadPool(const AsyncUploadPool &) = delete;
+    AsyncUploadPool &operator=(const AsyncUploadPool &) = delete;
+
+    bool mustRetire();
+    void retire();
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable queueCondition;
+    std::condition_variable doneCondition;
+    std::condition_variable exitCondition;
+    std::deque<Operation *> queue;
+    std::map<std::thread::id, std::thread> threads;
+    std::vector<std::thread> exited;
+    unsigned int targetWorkers = 0;
+    unsigned int liveWorkers = 0;
+    bool stopping = false;
+};
+
+#endif // ASYNC_UPLOAD_POOL_H
@@ -4,6 +4,10 @@
 #include "icommunicationmanager.h"
 #include "AuthenticationDataLoader.h"
 
+#include <gcrypt.h>
+
+#include <atomic>
+
 class AuthenticationManager
 {
 public:
@@ -89,6 +93,57 @@ public:
      */
     CommunicationOperationResult setCertificate(Certificate certificate);
 
+    /**
+     * @brief Set authenticated session time to live. While a session is alive,
+     *        calls to authenticate for the same TargetHardware (ID, position
+     *        and IP) and certificate will succeed without a new handshake.
+     *        Sessions are shared by all authentication managers in the
+     *        process. The default value is 0, which disables the session cache.
+     *
+     * @param[in] ttlS session time to live in seconds.
+     *
+     * @return COMMUNICATION_OPERATION_OK if success.
+     * @return COMMUNICATION_OPERATION_ERROR otherwise.
+     */
+    CommunicationOperationResult setSessionTtl(unsigned int ttlS);
+
+    /**
+     * @brief Invalidate the authenticated session for the current
+     *        TargetHardware and certificate, so the next call to authenticate
+     *        will perform a new handshake.
+     *
+     * @return COMMUNICATION_OPERATION_OK if success.
+     * @return COMMUNICATION_OPERATION_ERROR otherwise.
+     */
+    CommunicationOperationResult invalidateSession();
+
+    /**
+     * @brief Set the number of threads used to encrypt the certificate.
+     *        The certificate is encrypted in independent chunks, which are
+     *        distributed among the calling thread and threads of the shared
+     *        WorkerPool. The default value is 1.
+     *
+     * @param[in] workers the number of workers, 0 to use one worker per
+     *                    available CPU.
+     *
+     * @return COMMUNICATION_OPERATION_OK if success.
+     * @return COMMUNICATION_OPERATION_ERROR otherwise.
+     */
+    CommunicationOperationResult setEncryptionWorkers(unsigned int workers);
+
+    /**
+     * @brief Set the preferred format of the encrypted certificate chunks.
+     *        The preferred format is only used if the TargetHardware lists
+     *        it in the authentication initialization response, otherwise
+     *        CIPHERTEXT_FORMAT_ADVANCED is used.
+     *
+     * @param[in] format the preferred ciphertext format.
+     *
+     * @return COMMUNICATION_OPERATION_OK if success.
+     * @return COMMUNICATION_OPERATION_ERROR otherwise.
+     */
+    CommunicationOperationResult setCiphertextFormat(CiphertextFormat format);
+
     /**
      * Register a callback for authentication initialization response.
      *
@@ -137,6 +192,14 @@ public:
      */
     CommunicationOperationResult authenticate();
 
+    /**
+     * @brief Get the time spent encrypting the certificate since the last
+     *        call, and start counting again.
+     *
+     * @return the encryption time in microseconds.
+     */
+    uint64_t takeEncryptionTimeUs();
+
     /**
      * @brief Abort authentication operation.
      *
@@ -147,19 +210,63 @@ public:
      */
     CommunicationOperationResult abortAuthentication(AbortSource abortSource);
 
+    /**
+     * @brief Read a whole file and encode it as uppercase hex, the way the
+     *        certificate is encrypted. The file is read in a single call
+     *        into a buffer of its size.
+     *
+     * @param[in] fp the file, read from its start.
+     * @param[out] hexContent the hex encoded content.
+     *
+     * @return true if success, false otherwise.
+     */
+    static bool readHexContent(FILE *fp, std::string &hexContent);
+
 private:
     std::unique_ptr<AuthenticationDataLoader> authenticator;
 
+    std::string targetHardwareId;
+    std::string targetHardwarePosition;
+    std::string targetHardwareIp;
+    std::string certificatePath;
+    std::string certificateFingerprint;
+    unsigned int sessionTtlS;
+    unsigned int encryptionWorkers;
+    CiphertextFormat ciphertextFormat;
+    std::atomic<uint64_t> encryptionTimeUs;
+
+    /**
+     * @brief Build the session cache key for the current TargetHardware
+     *        and certificate. The certificate is identified by its content
+     *        fingerprint, computed once when the certificate is set, so a
+     *        changed certificate file starts a new session once it's set
+     *        again.
+     *
+     * @param[out] key the session key.
+     *
+     * @return true if the key could be built, false otherwise.
+     */
+    bool getSessionKey(std::string &key);
+
     class CryptoContext {
         public:
             CryptoContext()
             {
                 key.clear();
+                publicKey = NULL;
+                ciphertextFormat = CIPHERTEXT_FORMAT_ADVANCED;
                 cypheredData = NULL;
+                cypheredDataSize = 0;
+                cypheredDataCapacity = 0;
             }
             ~CryptoContext()
             {
                 key.clear();
+                if (publicKey != NULL)
+                {
+                    gcry_sexp_release(publicKey);
+                    publicKey = NULL;
+                }
                 if (cypheredData != NULL)
                 {
                     free(cypheredData);
@@ -167,9 +274,34 @@ private:
                 }
             }
 
+            /**
+             * @brief Set the TargetHardware public key. The key is only
+             *        parsed if it differs from the current one, so the
+             *        parsed key is reused across chunks and retries.
+             *
+             * @param[in] hexKey the public key S-expression, hex encoded.
+             *
+             * @return true if success, false otherwise.
+             */
+            bool setKey(const std::string &hexKey);
+
+            /**
+             * @brief Make sure the encrypted data buffer can hold size bytes.
+             *        The buffer is reused between authentications and only
+             *        grows.
+             *
+             * @param[in] size the required size.
+             *
+             * @return true if success, false otherwise.
+             */
+            bool reserve(size_t size);
+
             std::string key;
+            gcry_sexp_t publicKey;
+            CiphertextFormat ciphertextFormat;
             char *cypheredData;
             size_t cypheredDataSize;
+            size_t cypheredDataCapacity;
     };
     CryptoContext *cryptoContext;
 
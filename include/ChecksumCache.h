@@ -0,0 +1,98 @@
+#ifndef CHECKSUM_CACHE_H
+#define CHECKSUM_CACHE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <sys/types.h>
+#include <time.h>
+
+#define SHA256_SIZE 32
+
+/**
+ * @brief Process-wide cache of load image checksums. Checksums are shared
+ *        by every handler that loads the same file, so loading the same
+ *        part number to many TargetHardwares streams it only once to
+ *        compute them. Files are identified by path, modification time and
+ *        size, so a file that changes on disk is checksummed again. Only
+ *        the checksums are cached, the transfer itself is read by the
+ *        ARINC-615A uploader from the file.
+ */
+class ChecksumCache
+{
+public:
+    /**
+     * @brief Get the process-wide checksum cache.
+     *
+     * @return the checksum cache.
+     */
+    static ChecksumCache &getInstance();
+
+    /**
+     * @brief Get the CRC-32 (ISO 3309) and SHA-256 of a file. Checksums are
+     *        computed on the first call for the file, streaming it, and
+     *        cached until the file changes. Concurrent callers for the same
+     *        file wait for the first one.
+     *
+     * @param[in] path the file path.
+     * @param[out] crc32 the file CRC-32. May be NULL.
+     * @param[out] sha256 the file SHA-256, SHA256_SIZE bytes. May be NULL.
+     * @param[in] cancel if not NULL, the computation is abandoned as soon
+     *                   as it's set, and the next call starts it again.
+     *
+     * @return true if success, false if the file isn't a regular file,
+     *         can't be read, changed while it was read or the computation
+     *         was cancelled.
+     */
+    bool getChecksums(const std::string &path, uint32_t *crc32,
+                      unsigned char *sha256,
+                      const std::atomic<bool> *cancel = NULL);
+
+    /**
+     * @brief Get the number of files currently cached.
+     *
+     * @return the number of files.
+     */
+    size_t size();
+
+private:
+    // Checksums of one version of a file. Entries are replaced, not
+    // updated, when the file changes, so a computation in progress always
+    // belongs to the entry it was started for.
+    struct Entry
+    {
+        Entry();
+
+        std::string path;
+        size_t size;
+        time_t mtime;
+        long mtimeNs;
+        uint64_t lastUse;
+
+        std::mutex checksumsMutex;
+        bool checksumsValid;
+        uint32_t crc32;
+        unsigned char sha256[SHA256_SIZE];
+    };
+
+    ChecksumCache();
+    ChecksumCache(const ChecksumCache &) = delete;
+    ChecksumCache &operator=(const ChecksumCache &) = delete;
+
+    static bool computeChecksums(Entry &entry, const std::atomic<bool> *cancel);
+
+    /**
+     * @brief Drop the least recently used entries once the cache is full.
+     *        Must be called with the cache lock held.
+     */
+    void evict();
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> entries;
+    uint64_t useCount;
+};
+
+#endif // CHECKSUM_CACHE_H
@@ -6,6 +6,7 @@
 #include "FindARINC615A.h"
 
 #include <memory>
+#include <mutex>
 
 /**
  * @brief Communication manager. This class is responsible for managing all
@@ -161,6 +162,49 @@ public:
      */
     CommunicationOperationResult setLoadList(Load *load_list, size_t load_list_size);
 
+    /**
+     * @brief Add a load to the end of the load list.
+     *
+     * @param[in] load the load.
+     *
+     * @return COMMUNICATION_OPERATION_OK if success.
+     * @return COMMUNICATION_OPERATION_ERROR otherwise.
+     */
+    CommunicationOperationResult addLoad(const Load *load);
+
+    /**
+     * @brief Remove all loads with the given name from the load list.
+     *
+     * @param[in] loadName the load name.
+     *
+     * @return COMMUNICATION_OPERATION_OK if at least one load was removed.
+     * @return COMMUNICATION_OPERATION_ERROR otherwise.
+     */
+    CommunicationOperationResult removeLoad(const char *loadName);
+
+    /**
+     * @brief Remove all loads from the load list.
+     *
+     * @return COMMUNICATION_OPERATION_OK if success.
+     * @return COMMUNICATION_OPERATION_ERROR otherwise.
+     */
+    CommunicationOperationResult clearLoadList();
+
+    /**
+     * @brief Get the checksums of the load list images. Checksums are
+     *        computed by the calling thread, except the ones already in the
+     *        shared checksum cache.
+     *
+     * @param[out] checksums the checksums, one per load.
+     * @param[in,out] checksumsSize in: capacity of checksums, out: number
+     *                              of loads in the load list.
+     *
+     * @return COMMUNICATION_OPERATION_OK if success.
+     * @return COMMUNICATION_OPERATION_ERROR otherwise.
+     */
+    CommunicationOperationResult getLoadChecksums(LoadChecksum *checksums,
+                                                  size_t *checksumsSize);
+
     /**
      * Register a callback for upload initialization response.
      *
@@ -209,6 +253,38 @@ public:
      */
     CommunicationOperationResult upload();
 
+    /**
+     * @brief Resume an interrupted upload. Only the loads that were not
+     *        confirmed as completed by the TargetHardware since the last
+     *        call to upload are transmitted. If every load was confirmed,
+     *        nothing is transmitted.
+     *
+     * @return COMMUNICATION_OPERATION_OK if success.
+     * @return COMMUNICATION_OPERATION_ERROR otherwise.
+     */
+    CommunicationOperationResult resumeUpload();
+
+    /**
+     * @brief Record that the TargetHardware confirmed a load as completed.
+     *        The load is matched by its file name, or by its part number
+     *        when no file name is reported.
+     *        May be called from the uploader's status callback while an
+     *        upload is running.
+     *
+     * @param[in] headerFileName the header file name reported by the
+     *                           TargetHardware.
+     * @param[in] partNumber the part number reported by the TargetHardware.
+     */
+    void setLoadCompleted(const char *headerFileName, const char *partNumber);
+
+    /**
+     * @brief Get the size of the loads transmitted by the last call to
+     *        upload or resumeUpload. Files that can't be read don't count.
+     *
+     * @return the size in bytes.
+     */
+    uint64_t getUploadBytes();
+
     /**
      * @brief Abort upload operation.
      *
@@ -224,6 +300,26 @@ private:
     //       with different loaders.
     std::unique_ptr<UploadDataLoaderARINC615A> uploader;
     std::unique_ptr<FindARINC615A> finder;
+
+    // The load list is kept here and only handed to the uploader when it
+    // changed, so retries don't rebuild it. It's edited under loadListMutex,
+    // so getLoadChecksums and the uploader's status callback can read it
+    // from other threads.
+    std::mutex loadListMutex;
+    std::vector<ArincLoad> loadList;
+    bool loadListChanged;
+
+    // Loads of the load list confirmed as completed by the TargetHardware,
+    // used to resume interrupted uploads. Written from the uploader's status
+    // callback, under loadListMutex.
+    std::vector<bool> completedLoads;
+
+    /**
+     * @brief Forget the loads confirmed as completed.
+     */
+    void resetCompletedLoads();
+
+    uint64_t uploadBytes;
 };
 
 #endif // COMMUNICATION_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,135 @@
+#ifndef DEVICE_TABLE_H
+#define DEVICE_TABLE_H
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <time.h>
+
+/**
+ * @brief Process-wide table of the TargetHardwares discovered by find.
+ *        Devices are identified by TargetHardware ID and position and keep
+ *        the time they were last seen. The table can be persisted to a
+ *        file, so discovered devices are known right after startup.
+ */
+class DeviceTable
+{
+public:
+    /**
+     * @brief A discovered device.
+     */
+    struct Device
+    {
+        std::string mac;
+        std::string ip;
+        std::string targetHardwareId;
+        std::string targetTypeName;
+        std::string targetPosition;
+        std::string literalName;
+        std::string manufacturerCode;
+        time_t lastSeen;
+    };
+
+    /**
+     * @brief Result of updating the table with a discovered device.
+     */
+    enum UpdateResult
+    {
+        DEVICE_INVALID,
+        DEVICE_NEW,
+        DEVICE_CHANGED,
+        DEVICE_UNCHANGED
+    };
+
+    /**
+     * @brief Get the process-wide device table.
+     *
+     * @return the device table.
+     */
+    static DeviceTable &getInstance();
+
+    /**
+     * @brief Add or refresh a device from the JSON reported by find.
+     *
+     * @param[in] deviceJson the device JSON.
+     * @param[in] now the time the device was seen.
+     * @param[out] device the parsed device. May be NULL.
+     *
+     * @return DEVICE_NEW or DEVICE_CHANGED if the device wasn't known or
+     *         its information changed, DEVICE_UNCHANGED if only its last
+     *         seen time was refreshed, DEVICE_INVALID if the JSON can't be
+     *         parsed.
+     */
+    UpdateResult update(const std::string &deviceJson, time_t now,
+                        Device *device = NULL);
+
+    /**
+     * @brief Look up a device by TargetHardware ID and position.
+     *
+     * @param[in] targetHardwareId the TargetHardware ID.
+     * @param[in] targetPosition the TargetHardware position.
+     * @param[out] device the device.
+     *
+     * @return true if the device is known, false otherwise.
+     */
+    bool lookup(const std::string &targetHardwareId,
+                const std::string &targetPosition, Device &device);
+
+    /**
+     * @brief Get all known devices.
+     *
+     * @return the devices.
+     */
+    std::vector<Device> list();
+
+    /**
+     * @brief Forget all devices. The persistence file, if any, is emptied
+     *        on the next flush.
+     */
+    void clear();
+
+    /**
+     * @brief Tell whether the table is persisted to a file.
+     *
+     * @return true if a persistence file is set, false otherwise.
+     */
+    bool isPersistent();
+
+    /**
+     * @brief Set the file the table is persisted to and load the devices
+     *        stored in it. Devices already in the table are kept, unless
+     *        the file has a more recent version of them.
+     *
+     * @param[in] path the file path, empty to disable persistence.
+     *
+     * @return true if success or the file doesn't exist yet, false if the
+     *         file can't be parsed.
+     */
+    bool setPersistencePath(const std::string &path);
+
+    /**
+     * @brief Write the table to the persistence file if devices were added,
+     *        changed or removed since the last flush. Last seen times that
+     *        were only refreshed are written with the next change.
+     *
+     * @return true if success or there's nothing to write, false otherwise.
+     */
+    bool flush();
+
+private:
+    DeviceTable() = default;
+    DeviceTable(const DeviceTable &) = delete;
+    DeviceTable &operator=(const DeviceTable &) = delete;
+
+    static std::string key(const std::string &targetHardwareId,
+                           const std::string &targetPosition);
+    UpdateResult updateLocked(const Device &device);
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Device> devices;
+    std::string persistencePath;
+    bool dirty = false;
+};
+
+#endif // DEVICE_TABLE_H
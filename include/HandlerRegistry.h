@@ -0,0 +1,125 @@
+#ifndef HANDLER_REGISTRY_H
+#define HANDLER_REGISTRY_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+struct CommunicationHandler;
+
+#define HANDLER_REGISTRY_SHARDS 16
+
+/**
+ * @brief Registry of live handlers, a table of slots spread over shards,
+ *        each with its own lock, so handlers can be created and destroyed
+ *        from many threads without contending on one lock. A handler's
+ *        shard is picked from its address, so it's found from the pointer
+ *        without dereferencing it, and an unknown or already destroyed
+ *        pointer is refused instead of used.
+ *
+ *        An id holds the slot index in its low half and the slot generation
+ *        in its high half. The generation is bumped whenever the slot is
+ *        freed, so the id of a destroyed handler is stale and never resolves
+ *        to the handler that reuses its slot. Lookups by id pin the handler,
+ *        which can't be removed until every pin is released.
+ */
+class HandlerRegistry
+{
+public:
+    /**
+     * @brief Register a handler.
+     *
+     * @param[in] handler the handler.
+     *
+     * @return the handler id, never 0.
+     */
+    uint64_t add(struct CommunicationHandler *handler);
+
+    /**
+     * @brief Pin the live handler with the given id.
+     *
+     * @param[in] id the handler id.
+     *
+     * @return the handler, or nullptr if there's no live handler with this
+     *         id or it's being removed.
+     */
+    struct CommunicationHandler *acquire(uint64_t id);
+
+    /**
+     * @brief Pin a registered handler, like acquire does.
+     *
+     * @param[in] handler the handler.
+     *
+     * @return true if success, false if the handler isn't registered or is
+     *         being removed.
+     */
+    bool pin(struct CommunicationHandler *handler);
+
+    /**
+     * @brief Release a handler pinned by acquire or pin.
+     *
+     * @param[in] handler the handler.
+     *
+     * @return true if success, false if the handler isn't pinned.
+     */
+    bool release(struct CommunicationHandler *handler);
+
+    /**
+     * @brief Stop lookups from finding the handler and wait for the callers
+     *        that pinned it to release it.
+     *
+     * @param[in] handler the handler.
+     *
+     * @return true if success, false if the handler isn't registered or is
+     *         being removed already.
+     */
+    bool retire(struct CommunicationHandler *handler);
+
+    /**
+     * @brief Free the slot of a retired handler.
+     *
+     * @param[in] handler the handler.
+     */
+    void remove(struct CommunicationHandler *handler);
+
+    /**
+     * @brief Run a function on every registered handler. Handlers can't be
+     *        removed while the function runs on them, so it must be quick
+     *        and must not destroy handlers itself.
+     *
+     * @param[in] function the function.
+     */
+    void forEach(const std::function<void(struct CommunicationHandler *)> &function);
+
+private:
+    struct Slot
+    {
+        struct CommunicationHandler *handler = nullptr;
+        uint32_t generation = 1;
+        uint32_t pins = 0;
+        bool retiring = false;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::condition_variable unpinned;
+        // Slots never move, so a slot pointer stays valid while the shard
+        // grows.
+        std::deque<Slot> slots;
+        std::vector<size_t> freeSlots;
+        std::unordered_map<struct CommunicationHandler *, uint32_t> indexes;
+    };
+
+    static uint32_t shardOf(struct CommunicationHandler *handler);
+    static uint64_t makeId(uint32_t generation, uint32_t index);
+    static Slot *find(Shard &shard, struct CommunicationHandler *handler);
+
+    Shard shards[HANDLER_REGISTRY_SHARDS];
+};
+
+#endif // HANDLER_REGISTRY_H
@@ -0,0 +1,63 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Minimal HTTP server for metrics scrapes. It listens on the loopback
+ *        interface only and answers every request with the text produced by
+ *        the render function, from a thread of its own, so scrapes never run
+ *        on the upload threads.
+ */
+class MetricsServer
+{
+public:
+    typedef std::function<std::string()> RenderFunction;
+
+    MetricsServer() = default;
+    ~MetricsServer();
+
+    /**
+     * @brief Start serving. A running server is stopped first.
+     *
+     * @param[in] port the TCP port, 0 to let the system choose one.
+     * @param[in] contentType the Content-Type of the responses.
+     * @param[in] render the function producing the response body.
+     *
+     * @return true if success, false if the port can't be bound.
+     */
+    bool start(unsigned short port, const std::string &contentType,
+               RenderFunction render);
+
+    /**
+     * @brief Stop serving and wait for the server thread.
+     */
+    void stop();
+
+    /**
+     * @brief Get the port being served.
+     *
+     * @return the port, 0 if the server isn't running.
+     */
+    unsigned short getPort();
+
+private:
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+
+    void run();
+    void serve(int connectionFd);
+
+    std::mutex mutex;
+    std::thread thread;
+    int listenFd = -1;
+    int stopFd = -1;
+    unsigned short port = 0;
+    std::string contentType;
+    RenderFunction render;
+};
+
+#endif // METRICS_SERVER_H
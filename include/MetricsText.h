@@ -0,0 +1,59 @@
+#ifndef METRICS_TEXT_H
+#define METRICS_TEXT_H
+
+#include "icommunicationmanager.h"
+
+#include <stdint.h>
+#include <string>
+
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/**
+ * @brief Builder of the OpenMetrics exposition text. Every metric name gets
+ *        the arinc615a_ prefix. Latencies are exported as histograms in
+ *        seconds, with the histogram buckets as upper bounds.
+ */
+class MetricsText
+{
+public:
+    /**
+     * @brief Add a counter.
+     *
+     * @param[in] name the metric name, without the _total suffix.
+     * @param[in] help the metric description.
+     * @param[in] value the counter value.
+     */
+    void counter(const char *name, const char *help, uint64_t value);
+
+    /**
+     * @brief Add a gauge.
+     *
+     * @param[in] name the metric name.
+     * @param[in] help the metric description.
+     * @param[in] value the gauge value.
+     */
+    void gauge(const char *name, const char *help, uint64_t value);
+
+    /**
+     * @brief Add a latency histogram.
+     *
+     * @param[in] name the metric name.
+     * @param[in] help the metric description.
+     * @param[in] histogram the histogram.
+     */
+    void histogram(const char *name, const char *help, const LatencyHistogram &histogram);
+
+    /**
+     * @brief Terminate the exposition and get its text.
+     *
+     * @return the text.
+     */
+    std::string finish();
+
+private:
+    void family(const char *name, const char *type, const char *help);
+
+    std::string text;
+};
+
+#endif // METRICS_TEXT_H
@@ -0,0 +1,65 @@
+#ifndef PORT_ALLOCATOR_H
+#define PORT_ALLOCATOR_H
+
+#include <mutex>
+#include <unordered_set>
+
+/**
+ * @brief Allocator of UDP ports from a range, used for the DataLoader TFTP
+ *        server ports. Ports are handed out skipping the ones held by other
+ *        users and the ones that can't be bound, so concurrent uploads never
+ *        share a server port. The search starts after the last allocated
+ *        port, so a just released port isn't reused right away while the
+ *        TargetHardware may still send to it.
+ */
+class PortAllocator
+{
+public:
+    /**
+     * @brief Create an allocator.
+     *
+     * @param[in] first the first port of the range.
+     * @param[in] last the last port of the range.
+     */
+    PortAllocator(unsigned short first, unsigned short last);
+
+    /**
+     * @brief Set the range of ports. Allocated ports stay allocated.
+     *
+     * @param[in] first the first port of the range.
+     * @param[in] last the last port of the range.
+     *
+     * @return true if success, false if the range is empty or starts at 0.
+     */
+    bool setRange(unsigned short first, unsigned short last);
+
+    /**
+     * @brief Allocate a port that's not allocated yet and can be bound.
+     *
+     * @param[out] port the port.
+     *
+     * @return true if success, false if no port of the range is available.
+     */
+    bool allocate(unsigned short *port);
+
+    /**
+     * @brief Release an allocated port.
+     *
+     * @param[in] port the port.
+     */
+    void release(unsigned short port);
+
+private:
+    PortAllocator(const PortAllocator &) = delete;
+    PortAllocator &operator=(const PortAllocator &) = delete;
+
+    static bool isBindable(unsigned short port);
+
+    std::mutex mutex;
+    unsigned short firstPort;
+    unsigned short lastPort;
+    unsigned short nextPort;
+    std::unordered_set<unsigned short> allocated;
+};
+
+#endif // PORT_ALLOCATOR_H
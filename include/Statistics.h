@@ -0,0 +1,45 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include "icommunicationmanager.h"
+
+#include <chrono>
+
+/**
+ * @brief Helpers to update handler statistics. They don't lock, callers
+ *        hold the lock of the statistics they change.
+ */
+class Statistics
+{
+public:
+    /**
+     * @brief Add a duration to a latency histogram. Bucket i counts the
+     *        durations below 2^i ms, the last bucket the longer ones.
+     *
+     * @param[in,out] histogram the histogram.
+     * @param[in] duration the duration.
+     */
+    static void recordLatency(LatencyHistogram *histogram,
+                              std::chrono::steady_clock::duration duration);
+
+    /**
+     * @brief Add a latency histogram to another.
+     *
+     * @param[in,out] into the histogram added to.
+     * @param[in] from the histogram to add.
+     */
+    static void mergeLatency(LatencyHistogram *into, const LatencyHistogram &from);
+
+    /**
+     * @brief Add handler statistics to others.
+     *
+     * @param[in,out] into the statistics added to.
+     * @param[in] from the statistics to add.
+     */
+    static void merge(HandlerStats *into, const HandlerStats &from);
+
+private:
+    Statistics() = delete;
+};
+
+#endif // STATISTICS_H
@@ -0,0 +1,144 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Trace points for the timeline of communication operations. They are only
+ * compiled in builds with COMMUNICATION_MANAGER_TRACE defined (make trace),
+ * otherwise they expand to nothing.
+ *
+ * Trace names must be string literals, only the pointer is recorded.
+ *
+ * TRACE_SCOPE(name)                 Span from here to the end of the scope.
+ * TRACE_SPAN(name, start, end)      Span between two steady_clock times.
+ * TRACE_INSTANT(name)               Single point in time.
+ */
+#ifdef COMMUNICATION_MANAGER_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Events kept per thread, older events are overwritten.
+#define TRACE_BUFFER_EVENTS 4096
+
+/**
+ * @brief Process-wide trace recorder. Every thread records into a ring
+ *        buffer of its own without locks. Buffers of finished threads are
+ *        kept, and reused by new threads, so short-lived workers neither
+ *        lose their events nor grow the memory used.
+ */
+class Trace
+{
+public:
+    /**
+     * @brief Records a span from its construction to its destruction.
+     */
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name)
+            : name(name), start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~Scope()
+        {
+            Trace::span(name, start, std::chrono::steady_clock::now());
+        }
+
+    private:
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+        const char *name;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /**
+     * @brief Record a span.
+     *
+     * @param[in] name the span name, a string literal.
+     * @param[in] start the span start.
+     * @param[in] end the span end.
+     */
+    static void span(const char *name,
+                     std::chrono::steady_clock::time_point start,
+                     std::chrono::steady_clock::time_point end);
+
+    /**
+     * @brief Record a point in time.
+     *
+     * @param[in] name the event name, a string literal.
+     */
+    static void instant(const char *name);
+
+    /**
+     * @brief Write the events of all threads as Chrome trace JSON, which
+     *        can be opened in chrome://tracing or Perfetto. Threads keep
+     *        recording while the trace is written; events overwritten
+     *        meanwhile are left out.
+     *
+     * @param[in] path the file path.
+     *
+     * @return true if success, false otherwise.
+     */
+    static bool dump(const std::string &path);
+
+private:
+    struct Event
+    {
+        // Odd while the event is being written.
+        std::atomic<uint64_t> sequence;
+        std::atomic<const char *> name;
+        std::atomic<uint64_t> startUs;
+        std::atomic<uint64_t> durationUs;
+        std::atomic<uint32_t> threadId;
+        std::atomic<bool> instant;
+    };
+
+    struct Buffer
+    {
+        Buffer() : events(TRACE_BUFFER_EVENTS), head(0) {}
+
+        std::vector<Event> events;
+        std::atomic<uint64_t> head;
+    };
+
+    class ThreadBuffer
+    {
+    public:
+        ThreadBuffer();
+        ~ThreadBuffer();
+
+        Buffer *buffer;
+        uint32_t threadId;
+    };
+
+    static void record(const char *name, uint64_t startUs, uint64_t durationUs,
+                       bool instant);
+    static uint64_t toUs(std::chrono::steady_clock::time_point time);
+
+    static std::mutex buffersMutex;
+    static std::vector<std::unique_ptr<Buffer>> buffers;
+    static std::vector<Buffer *> freeBuffers;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_SPAN(name, start, end) Trace::span(name, start, end)
+#define TRACE_INSTANT(name) Trace::instant(name)
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SPAN(name, start, end) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+
+#endif // COMMUNICATION_MANAGER_TRACE
+
+#endif // TRACE_H
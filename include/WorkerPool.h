@@ -0,0 +1,73 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Process-wide pool of worker threads, shared by every handler, so
+ *        the number of threads doesn't grow with concurrent operations.
+ *        It has one thread per available CPU, but one, since callers work
+ *        as well. Threads are started on first use.
+ */
+class WorkerPool
+{
+public:
+    /**
+     * @brief Get the process-wide worker pool.
+     *
+     * @return the worker pool.
+     */
+    static WorkerPool &getInstance();
+
+    /**
+     * @brief Run a function on the calling thread and on up to helpers pool
+     *        threads at the same time. The function is expected to share
+     *        its work with the other runs, for instance by taking the next
+     *        pending item until there are none left. Returns once the
+     *        calling thread's run returned and every run started by a pool
+     *        thread finished. Pool threads busy with other calls don't
+     *        start the function after that, so it may run on fewer threads.
+     *
+     * @param[in] function the function.
+     * @param[in] helpers the maximum number of pool threads to use.
+     */
+    void run(const std::function<void()> &function, unsigned int helpers);
+
+    /**
+     * @brief Get the number of pool threads.
+     *
+     * @return the number of threads.
+     */
+    unsigned int size() const;
+
+private:
+    WorkerPool();
+    ~WorkerPool();
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    struct Job
+    {
+        const std::function<void()> *function;
+        std::mutex mutex;
+        std::condition_variable finished;
+        unsigned int running = 0;
+        bool closed = false;
+    };
+
+    void workerLoop();
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::shared_ptr<Job>> queue;
+    std::vector<std::thread> threads;
+    bool stopping;
+};
+
+#endif // WORKER_POOL_H
@@ -2,12 +2,18 @@
 #define ICOMMUNICATION_MANAGER_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
 /**
  * @brief The commuication handler for ARINC-615A communication.
  */
 typedef struct CommunicationHandler *CommunicationHandlerPtr;
 
+/**
+ * @brief The handler for an asynchronous upload operation.
+ */
+typedef struct AsyncUpload *AsyncUploadPtr;
+
 /**
  * @brief Enum with possible return from interface functions.
  * Possible return values are:
@@ -26,6 +32,47 @@ typedef enum
     OPERATION_ABORTED_BY_THE_OPERATOR
 } AbortSource;
 
+/**
+ * @brief Enum with possible states of an asynchronous upload operation.
+ * Possible values are:
+ * - ASYNC_UPLOAD_RUNNING:                          Operation is in progress.
+ * - ASYNC_UPLOAD_FINISHED:                         Operation has finished and
+ *                                                  its result is available.
+ */
+typedef enum
+{
+    ASYNC_UPLOAD_RUNNING = 0,
+    ASYNC_UPLOAD_FINISHED
+} AsyncUploadState;
+
+/**
+ * @brief Enum with formats for the encrypted certificate chunks sent during
+ * authentication. Each chunk is preceded by its size.
+ * Possible values are:
+ * - CIPHERTEXT_FORMAT_ADVANCED:                    Human readable S-expression.
+ *                                                  Supported by all
+ *                                                  TargetHardwares.
+ * - CIPHERTEXT_FORMAT_CANONICAL:                   Canonical S-expression.
+ * - CIPHERTEXT_FORMAT_RAW:                         Raw big-endian RSA output,
+ *                                                  padded to the key size.
+ */
+typedef enum
+{
+    CIPHERTEXT_FORMAT_ADVANCED = 0,
+    CIPHERTEXT_FORMAT_CANONICAL,
+    CIPHERTEXT_FORMAT_RAW
+} CiphertextFormat;
+
+/**
+ * @brief DataLoader TFTP server ports. Setting the DataLoader server port to
+ *        TFTP_DATALOADER_SERVER_PORT_AUTO allocates a free port from the
+ *        DataLoader port range for each upload. The default range is the
+ *        IANA dynamic port range.
+ */
+#define TFTP_DATALOADER_SERVER_PORT_AUTO 0
+#define TFTP_DATALOADER_PORT_RANGE_FIRST 49152
+#define TFTP_DATALOADER_PORT_RANGE_LAST 65535
+
 #define MAX_NAME_SIZE 255
 typedef struct
 {
@@ -38,6 +85,177 @@ typedef struct
     char certificatePath[MAX_NAME_SIZE];
 } Certificate;
 
+/**
+ * @brief Checksums of a load image.
+ */
+typedef struct
+{
+    char loadName[MAX_NAME_SIZE];
+    uint32_t crc32;
+    unsigned char sha256[32];
+} LoadChecksum;
+
+/**
+ * @brief A TargetHardware discovered by find, as kept in the device cache.
+ *        lastSeen is the time the device last answered a find, in seconds
+ *        since the Epoch.
+ */
+typedef struct
+{
+    char mac[MAX_NAME_SIZE];
+    char ip[MAX_NAME_SIZE];
+    char targetHardwareId[MAX_NAME_SIZE];
+    char targetTypeName[MAX_NAME_SIZE];
+    char targetPosition[MAX_NAME_SIZE];
+    char literalName[MAX_NAME_SIZE];
+    char manufacturerCode[MAX_NAME_SIZE];
+    int64_t lastSeen;
+} DiscoveredDevice;
+
+#define MAX_DESCRIPTION_SIZE 256
+
+/**
+ * @brief Upload initialization response, as sent by the TargetHardware.
+ */
+typedef struct
+{
+    unsigned short operationAcceptanceStatusCode;
+    char statusDescription[MAX_DESCRIPTION_SIZE];
+} UploadInitializationResponse;
+
+/**
+ * @brief Upload status of a single header file.
+ */
+typedef struct
+{
+    char headerFileName[MAX_NAME_SIZE];
+    char loadPartNumberName[MAX_NAME_SIZE];
+    unsigned short loadRatio;
+    unsigned short loadStatus;
+    char loadStatusDescription[MAX_DESCRIPTION_SIZE];
+} UploadHeaderFileStatus;
+
+/**
+ * @brief Upload information status, as sent by the TargetHardware.
+ *        headerFiles points to numberOfHeaderFiles entries and is only
+ *        valid during the callback.
+ */
+typedef struct
+{
+    unsigned short uploadOperationStatusCode;
+    char uploadStatusDescription[MAX_DESCRIPTION_SIZE];
+    unsigned short counter;
+    unsigned short exceptionTimer;
+    unsigned short estimatedTime;
+    unsigned short loadListRatio;
+    size_t numberOfHeaderFiles;
+    const UploadHeaderFileStatus *headerFiles;
+} UploadInformationStatus;
+
+/**
+ * @brief Retry policy for uploads. Failed authentications and failed
+ *        transfers are retried with separate budgets, waiting between
+ *        attempts with exponential backoff:
+ *        initialBackoffMs * backoffMultiplier ^ (failures - 1), capped at
+ *        maxBackoffMs, or not capped if maxBackoffMs is 0, and reduced by a
+ *        random amount of up to jitterPercent percent, so handlers that
+ *        failed together don't retry together.
+ *
+ * - maxAuthenticationAttempts: Attempts to authenticate, 0 or 1 disables
+ *                              authentication retries.
+ * - maxTransferAttempts:       Attempts to transfer the load list, 0 or 1
+ *                              disables transfer retries. Retries resume
+ *                              the upload if checkpointing is enabled.
+ * - retryableStatusCodes:      Upload operation status codes which make a
+ *                              failed transfer retryable, checked against
+ *                              the last status received from the
+ *                              TargetHardware. If empty, every failed
+ *                              transfer is retryable.
+ */
+#define MAX_RETRYABLE_STATUS_CODES 16
+typedef struct
+{
+    unsigned int maxAuthenticationAttempts;
+    unsigned int maxTransferAttempts;
+    unsigned int initialBackoffMs;
+    unsigned int maxBackoffMs;
+    unsigned int backoffMultiplier;
+    unsigned int jitterPercent;
+    unsigned short retryableStatusCodes[MAX_RETRYABLE_STATUS_CODES];
+    size_t retryableStatusCodesSize;
+} UploadRetryPolicy;
+
+/**
+ * @brief Latency histogram. buckets[i] counts the samples shorter than
+ *        2^i milliseconds which don't fit a previous bucket, and the last
+ *        bucket counts all longer samples.
+ */
+#define LATENCY_HISTOGRAM_BUCKETS 20
+typedef struct
+{
+    uint64_t count;
+    uint64_t totalUs;
+    uint64_t maxUs;
+    uint64_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+} LatencyHistogram;
+
+/**
+ * @brief Statistics of a handler, since it was created or its statistics
+ *        were last reset.
+ *
+ * - uploads, uploadFailures:       Calls to upload, resume_upload and
+ *                                  asynchronous uploads, and the failed ones.
+ * - authentications,
+ *   authenticationFailures:        Authentication attempts, including
+ *                                  retries and cached sessions.
+ * - retries:                       Attempts retried by the retry policy.
+ * - bytesSent:                     Size of the loads of successful transfers.
+ * - statusMessages:                Status messages from the TargetHardware.
+ * - uploadLatency:                 Whole uploads, including retries.
+ * - authenticationLatency:         Authentication attempts.
+ * - encryptionLatency:             Certificate RSA encryption.
+ * - initializationLatency:         From the start of a transfer until the
+ *                                  initialization response.
+ * - transferLatency:               Transfer attempts.
+ * - statusInterval:                Time between status messages.
+ * - callbackLatency:               Time spent in application callbacks.
+ *
+ * Initialization response and status messages are only seen while a
+ * callback, checkpointing or a retry policy with status codes needs them.
+ */
+typedef struct
+{
+    uint64_t uploads;
+    uint64_t uploadFailures;
+    uint64_t authentications;
+    uint64_t authenticationFailures;
+    uint64_t retries;
+    uint64_t bytesSent;
+    uint64_t statusMessages;
+    LatencyHistogram uploadLatency;
+    LatencyHistogram authenticationLatency;
+    LatencyHistogram encryptionLatency;
+    LatencyHistogram initializationLatency;
+    LatencyHistogram transferLatency;
+    LatencyHistogram statusInterval;
+    LatencyHistogram callbackLatency;
+} HandlerStats;
+
+/**
+ * @brief An upload job for batch upload. Describes the TargetHardware and
+ *        the load list to be uploaded to it. The result field is filled
+ *        by upload_batch.
+ */
+typedef struct
+{
+    char targetHardwareId[MAX_NAME_SIZE];
+    char targetHardwarePosition[MAX_NAME_SIZE];
+    char targetHardwareIp[MAX_NAME_SIZE];
+    Load *loadList;
+    size_t loadListSize;
+    CommunicationOperationResult result;
+} UploadJob;
+
 /*
 *******************************************************************************
                                    CALLBACKS
@@ -89,6 +307,24 @@ typedef CommunicationOperationResult (*find_new_device)(
     const char *device,
     void *context);
 
+/**
+ * @brief Callback for batches of devices found. Devices are only valid
+ *        during the callback.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] devices the devices found.
+ * @param[in] devices_size the number of devices.
+ * @param[in] context the user context.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+typedef CommunicationOperationResult (*find_new_devices_batch_callback)(
+    CommunicationHandlerPtr handler,
+    const DiscoveredDevice *devices,
+    size_t devices_size,
+    void *context);
+
 /**
  * @brief Callback for upload initialization response.
  *
@@ -124,6 +360,40 @@ typedef CommunicationOperationResult (*upload_information_status_callback)(
     const char *upload_information_status_json,
     void *context);
 
+/**
+ * @brief Typed callback for upload initialization response. This callback
+ *        receives the same information as upload_initialization_response_callback,
+ *        without the need to parse JSON.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] response the upload initialization response.
+ * @param[in] context the user context.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+typedef CommunicationOperationResult (*upload_initialization_response_typed_callback)(
+    CommunicationHandlerPtr handler,
+    const UploadInitializationResponse *response,
+    void *context);
+
+/**
+ * @brief Typed callback for upload progress report. This callback receives
+ *        the same information as upload_information_status_callback,
+ *        without the need to parse JSON.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] status the upload information status.
+ * @param[in] context the user context.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+typedef CommunicationOperationResult (*upload_information_status_typed_callback)(
+    CommunicationHandlerPtr handler,
+    const UploadInformationStatus *status,
+    void *context);
+
 /**
  * @brief Callback for file not available. This callback is called for both
  *        authentication and upload operations.
@@ -145,6 +415,24 @@ typedef CommunicationOperationResult (*file_not_available_callback)(
     unsigned short *wait_time_s,
     void *context);
 
+/**
+ * @brief Callback for batch upload progress report. It is called from
+ *        the background context of the job's upload.
+ *
+ * @param[in] job the upload job this report belongs to.
+ * @param[in] job_index the index of the job in the batch.
+ * @param[in] upload_information_status_json JSON with upload information status.
+ * @param[in] context the user context.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+typedef CommunicationOperationResult (*upload_job_status_callback)(
+    const UploadJob *job,
+    size_t job_index,
+    const char *upload_information_status_json,
+    void *context);
+
 /*
 *******************************************************************************
                              MANAGEMENT OPERATIONS
@@ -162,15 +450,149 @@ CommunicationOperationResult create_handler(
     CommunicationHandlerPtr *handler);
 
 /**
- * Destroy a communication handler.
+ * Destroy a communication handler. A running asynchronous upload of the
+ * handler is aborted and this function blocks until it stops, as well as
+ * until a find that outlived its deadline finishes, and until every
+ * get_handler_by_id of the handler is released with release_handler.
  *
  * @param[in] handler a handler to ARINC-615A communication.
  * @return COMMUNICATION_OPERATION_OK if success.
- * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ * @return COMMUNICATION_OPERATION_ERROR if the handler isn't a live handler,
+ *         for instance if it was destroyed already.
  */
 CommunicationOperationResult destroy_handler(
     CommunicationHandlerPtr *handler);
 
+/**
+ * Get the handler id. Ids carry a generation, so the id of a destroyed
+ * handler is never given to another handler. They can be kept by other
+ * threads and later resolved with get_handler_by_id, which fails once the
+ * handler is destroyed.
+ *
+ * @param[in] handler a handler to ARINC-615A communication.
+ * @param[out] id the handler id.
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult get_handler_id(
+    CommunicationHandlerPtr handler, uint64_t *id);
+
+/**
+ * Get a handler from its id. The handler is pinned: it can be used until it's
+ * released with release_handler, and destroy_handler waits for the release.
+ *
+ * @param[in] id the handler id.
+ * @param[out] handler the handler, or NULL if there's no live handler
+ *                     with this id.
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR if the handler was destroyed or
+ *         never existed.
+ */
+CommunicationOperationResult get_handler_by_id(
+    uint64_t id, CommunicationHandlerPtr *handler);
+
+/**
+ * Release a handler got from get_handler_by_id.
+ *
+ * @param[in] handler the handler.
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR if the handler isn't pinned.
+ */
+CommunicationOperationResult release_handler(CommunicationHandlerPtr handler);
+
+/**
+ * Get the statistics of a handler.
+ *
+ * @param[in] handler the communication handler.
+ * @param[out] stats the statistics.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult get_handler_stats(
+    CommunicationHandlerPtr handler, HandlerStats *stats);
+
+/**
+ * Reset the statistics of a handler.
+ *
+ * @param[in] handler the communication handler.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult reset_handler_stats(
+    CommunicationHandlerPtr handler);
+
+/**
+ * Render the statistics of all handlers in the OpenMetrics text format.
+ * Statistics of destroyed handlers and of handlers whose statistics were
+ * reset are kept in the totals, so counters never go back. Besides the
+ * statistics of HandlerStats, it reports the number of handlers, running
+ * uploads, asynchronous uploads queued for a shared worker and batch jobs
+ * not started yet.
+ *
+ * Handlers are only locked to copy their statistics, so rendering doesn't
+ * hold back running uploads.
+ *
+ * @param[out] buffer the text, NUL terminated. May be NULL to get the
+ *                    required size.
+ * @param[in,out] buffer_size in: capacity of buffer, out: size needed,
+ *                            including the terminating NUL.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR if buffer is NULL or too small.
+ */
+CommunicationOperationResult get_metrics_text(char *buffer, size_t *buffer_size);
+
+/**
+ * Serve the text of get_metrics_text over HTTP on the loopback interface,
+ * for scrapers running on the same machine. Requests are answered by a
+ * thread of its own. A running server is stopped first.
+ *
+ * @param[in] port the TCP port, 0 to let the system choose one.
+ * @param[out] bound_port the port being served. May be NULL.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR if the port can't be bound.
+ */
+CommunicationOperationResult start_metrics_server(unsigned short port,
+                                                  unsigned short *bound_port);
+
+/**
+ * Stop the metrics server, if running.
+ *
+ * @return COMMUNICATION_OPERATION_OK
+ */
+CommunicationOperationResult stop_metrics_server();
+
+/**
+ * Write the timeline of the latest communication operations as Chrome trace
+ * JSON, which can be opened in chrome://tracing or Perfetto. It has spans
+ * for authentication, certificate encryption, upload attempts, upload
+ * initialization, transfers, status callbacks, retry backoffs and aborts.
+ * Every thread keeps its latest events only.
+ *
+ * Trace points are only compiled in builds made with tracing (make trace),
+ * they have no cost otherwise.
+ *
+ * @param[in] path the file path.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR if the file can't be written or the
+ *         library was built without tracing.
+ */
+CommunicationOperationResult dump_trace(const char *path);
+
+/**
+ * Tell whether the library was built with tracing (make trace).
+ *
+ * @param[out] enabled 1 if trace points are compiled in, 0 otherwise.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult get_trace_enabled(int *enabled);
+
 /*
 *******************************************************************************
                                     GENERAL
@@ -186,6 +608,11 @@ CommunicationOperationResult destroy_handler(
  *        TargetHardware and the DataLoader in the same machine, you must
  *        change the default port
  *
+ *        If port is TFTP_DATALOADER_SERVER_PORT_AUTO, a free port is taken
+ *        from the DataLoader port range (see set_tftp_dataloader_port_range)
+ *        at the start of each upload and given back when it finishes, so
+ *        handlers in the same process can upload at the same time.
+ *
  * @param[in] handler the communication handler.
  * @param[in] port the port to be used by DataLoader's TFTP server.
  *
@@ -195,6 +622,38 @@ CommunicationOperationResult destroy_handler(
 CommunicationOperationResult set_tftp_dataloader_server_port(
     CommunicationHandlerPtr handler, unsigned short port);
 
+/**
+ * @brief Get the port used by the DataLoader's TFTP server. For handlers
+ *        with automatic port allocation this is the port allocated to the
+ *        running upload, or TFTP_DATALOADER_SERVER_PORT_AUTO if there's no
+ *        upload running.
+ *
+ * @param[in] handler the communication handler.
+ * @param[out] port the port used by DataLoader's TFTP server.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult get_tftp_dataloader_server_port(
+    CommunicationHandlerPtr handler, unsigned short *port);
+
+/**
+ * @brief Set the range of ports used for automatic DataLoader TFTP server
+ *        port allocation. The range is shared by all handlers in the
+ *        process. Ports already bound by someone else are skipped. The
+ *        default range is TFTP_DATALOADER_PORT_RANGE_FIRST to
+ *        TFTP_DATALOADER_PORT_RANGE_LAST.
+ *
+ * @param[in] first_port the first port of the range.
+ * @param[in] last_port the last port of the range, inclusive.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR if the range is empty or starts
+ *         at port 0.
+ */
+CommunicationOperationResult set_tftp_dataloader_port_range(
+    unsigned short first_port, unsigned short last_port);
+
 /**
  * @brief Set TFTP server port for TargetHardware TFTP server. 
  *        This is the port to be used by the Dataloader's 
@@ -225,6 +684,78 @@ CommunicationOperationResult set_tftp_targethardware_server_port(
 CommunicationOperationResult set_certificate(
     CommunicationHandlerPtr handler, Certificate certificate);
 
+/**
+ * @brief Set authenticated session time to live. After a successful
+ *        authentication, uploads to the same TargetHardware (ID, position
+ *        and IP) with the same certificate skip the authentication
+ *        handshake until the session expires. Sessions are shared by all
+ *        handlers in the process and are invalidated when an upload fails.
+ *        The certificate is identified by its content when it's set, so
+ *        set it again after changing the certificate file.
+ *
+ *        The default value is 0, which disables the session cache.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] ttl_s session time to live in seconds.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult set_authentication_session_ttl(
+    CommunicationHandlerPtr handler, unsigned int ttl_s);
+
+/**
+ * @brief Set the number of threads used to encrypt the certificate during
+ *        authentication. The certificate is encrypted in independent chunks
+ *        that are distributed among the workers, which pays off for large
+ *        certificate chains. The calling thread is a worker, the others
+ *        come from a pool shared by every handler, with one thread per
+ *        available CPU but one, so they may be fewer when several handlers
+ *        authenticate at the same time.
+ *
+ *        The default value is 1.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] workers the number of workers, 0 to use one worker per
+ *                    available CPU.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult set_authentication_encryption_workers(
+    CommunicationHandlerPtr handler, unsigned int workers);
+
+/**
+ * @brief Set the preferred format of the encrypted certificate sent during
+ *        authentication. Compact formats reduce the data sent to the
+ *        TargetHardware, but are only used if the TargetHardware lists them
+ *        in its authentication initialization response. Otherwise
+ *        CIPHERTEXT_FORMAT_ADVANCED is used.
+ *
+ *        The default value is CIPHERTEXT_FORMAT_ADVANCED.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] format the preferred ciphertext format.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult set_authentication_ciphertext_format(
+    CommunicationHandlerPtr handler, CiphertextFormat format);
+
+/**
+ * @brief Invalidate the authenticated session for the handler's current
+ *        TargetHardware and certificate. The next upload will authenticate
+ *        again.
+ *
+ * @param[in] handler the communication handler.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult invalidate_authentication_session(
+    CommunicationHandlerPtr handler);
+
 /*
 *******************************************************************************
                                  FIND OPERATION
@@ -276,6 +807,46 @@ CommunicationOperationResult register_find_new_device_callback(
     find_new_device callback,
     void *context);
 
+/**
+ * @brief Register a callback for batches of devices found. Devices are
+ *        buffered and delivered when max_batch_size devices are buffered,
+ *        when a device arrives more than max_batch_delay_ms after the first
+ *        buffered one, and when the find operation finishes. May be used
+ *        together with the find new device callback.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] callback the callback, NULL to unregister it.
+ * @param[in] context the user context.
+ * @param[in] max_batch_size the maximum number of devices per batch.
+ * @param[in] max_batch_delay_ms the maximum time a device is buffered
+ *                               while others arrive, 0 for no limit.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult register_find_new_devices_batch_callback(
+    CommunicationHandlerPtr handler,
+    find_new_devices_batch_callback callback,
+    void *context,
+    size_t max_batch_size,
+    unsigned int max_batch_delay_ms);
+
+/**
+ * @brief Only report devices that are new or changed since they were last
+ *        seen through the find new device callback. Devices found again
+ *        without changes only refresh their last seen time in the device
+ *        cache. Disabled by default.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] enabled non-zero to report changes only, zero to report every
+ *                    device found.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult set_find_report_changes_only(
+    CommunicationHandlerPtr handler, int enabled);
+
 /**
  * Start find operation. This is a non-blocking function.
  * Devices found will be notified through the callback.
@@ -288,6 +859,82 @@ CommunicationOperationResult register_find_new_device_callback(
 CommunicationOperationResult find(
     CommunicationHandlerPtr handler);
 
+/**
+ * @brief Run a find operation bounded by a deadline. Devices are reported
+ *        through the find new device callback as they are found, and this
+ *        function returns once the find finishes or the deadline expires,
+ *        whichever comes first. The find finished callback is called once
+ *        in both cases. Devices found after the deadline are not reported,
+ *        but are still recorded in the device cache.
+ *
+ *        A new find can't start until the previous one really finished, so
+ *        this function waits for it, within the deadline.
+ *
+ *        The find probes the single network interface used by find, other
+ *        interfaces or subnets are not probed.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] deadline_ms the deadline in milliseconds.
+ *
+ * @return COMMUNICATION_OPERATION_OK if the find finished or the deadline
+ *         expired.
+ * @return COMMUNICATION_OPERATION_ERROR if the find failed or the previous
+ *         find didn't finish within the deadline.
+ */
+CommunicationOperationResult find_with_deadline(
+    CommunicationHandlerPtr handler, unsigned int deadline_ms);
+
+/**
+ * @brief Set the file the device cache is persisted to. While it's set,
+ *        every device found by any handler is kept in a process-wide device
+ *        cache, identified by TargetHardware ID and position. Without it,
+ *        only finds that report changes only or batch devices fill the
+ *        cache. The devices stored in the file are loaded right away, and
+ *        the file is updated when a find operation finishes if devices were
+ *        added or changed.
+ *
+ * @param[in] path the file path, NULL to stop persisting the cache.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR if the file can't be parsed.
+ */
+CommunicationOperationResult set_device_cache_file(const char *path);
+
+/**
+ * @brief Get the devices in the device cache.
+ *
+ * @param[out] devices the devices.
+ * @param[in,out] devices_size in: capacity of devices, out: number of
+ *                             devices in the cache.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult get_cached_devices(
+    DiscoveredDevice *devices, size_t *devices_size);
+
+/**
+ * @brief Get a device from the device cache.
+ *
+ * @param[in] target_hardware_id the TargetHardware ID.
+ * @param[in] target_hardware_pos the TargetHardware position.
+ * @param[out] device the device.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR if the device isn't in the cache.
+ */
+CommunicationOperationResult get_cached_device(
+    const char *target_hardware_id, const char *target_hardware_pos,
+    DiscoveredDevice *device);
+
+/**
+ * @brief Remove all devices from the device cache and its file.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult clear_device_cache();
+
 /*
 *******************************************************************************
                                 UPLOAD OPERATION
@@ -342,9 +989,26 @@ CommunicationOperationResult set_target_hardware_pos(
 CommunicationOperationResult set_target_hardware_ip(
     CommunicationHandlerPtr handler, const char *target_ip);
 
+/**
+ * @brief Set TargetHardware ID, position and IP from the device cache, so
+ *        a TargetHardware found before doesn't need a new find operation.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] target_id the TargetHardware ID.
+ * @param[in] target_pos the TargetHardware position.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR if the TargetHardware isn't in the
+ *         device cache.
+ */
+CommunicationOperationResult set_target_hardware_from_cache(
+    CommunicationHandlerPtr handler, const char *target_id, const char *target_pos);
+
 /**
  * @brief Set load list. This is the list of files to be transmitted using
- *        upload operation.
+ *        upload operation. The list is copied, so the caller's memory may be
+ *        released after this call. Loads must have a non empty, null
+ *        terminated name.
  *
  *        This function must be called before upload operation.
  *
@@ -358,6 +1022,62 @@ CommunicationOperationResult set_target_hardware_ip(
 CommunicationOperationResult set_load_list(
     CommunicationHandlerPtr handler, Load *load_list, size_t load_list_size);
 
+/**
+ * @brief Add a load to the end of the load list. The load list is kept
+ *        between uploads, so retries and small changes don't need the whole
+ *        list to be set again.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] load the load.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult add_load(
+    CommunicationHandlerPtr handler, const Load *load);
+
+/**
+ * @brief Remove all loads with the given name from the load list.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] load_name the load name.
+ *
+ * @return COMMUNICATION_OPERATION_OK if at least one load was removed.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult remove_load(
+    CommunicationHandlerPtr handler, const char *load_name);
+
+/**
+ * @brief Remove all loads from the load list.
+ *
+ * @param[in] handler the communication handler.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult clear_load_list(
+    CommunicationHandlerPtr handler);
+
+/**
+ * @brief Get the CRC-32 (ISO 3309) and SHA-256 of every load in the load
+ *        list. Checksums are computed by this function, streaming each file
+ *        once, and are shared by all handlers loading the same file until
+ *        it changes on disk. Uploads don't compute them.
+ *
+ * @param[in] handler the communication handler.
+ * @param[out] checksums the checksums, in load list order.
+ * @param[in,out] checksums_size in: capacity of checksums, out: number of
+ *                               loads in the load list.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR if a load can't be read or
+ *         checksums is too small.
+ */
+CommunicationOperationResult get_load_checksums(
+    CommunicationHandlerPtr handler, LoadChecksum *checksums,
+    size_t *checksums_size);
+
 /**
  * Register a callback for upload initialization response.
  *
@@ -388,6 +1108,38 @@ CommunicationOperationResult register_upload_information_status_callback(
     upload_information_status_callback callback,
     void *context);
 
+/**
+ * Register a typed callback for upload initialization response. It may be
+ * registered together with the JSON callback, in which case both are called.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] callback the callback.
+ * @param[in] context the user context.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult register_upload_initialization_response_typed_callback(
+    CommunicationHandlerPtr handler,
+    upload_initialization_response_typed_callback callback,
+    void *context);
+
+/**
+ * Register a typed callback for upload information status. It may be
+ * registered together with the JSON callback, in which case both are called.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] callback the callback.
+ * @param[in] context the user context.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult register_upload_information_status_typed_callback(
+    CommunicationHandlerPtr handler,
+    upload_information_status_typed_callback callback,
+    void *context);
+
 /**
  * Register a callback for file not available.
  *
@@ -413,6 +1165,54 @@ CommunicationOperationResult register_file_not_available_callback(
  */
 CommunicationOperationResult upload(CommunicationHandlerPtr handler);
 
+/**
+ * @brief Enable or disable upload checkpointing. While enabled, the loads
+ *        the TargetHardware reports as completed in its status messages are
+ *        recorded, so an interrupted upload can be continued with
+ *        resume_upload. The record is cleared by upload and whenever the
+ *        load list or the TargetHardware changes. Disabled by default.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] enabled non-zero to enable checkpointing, zero to disable it.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult set_upload_checkpoint(
+    CommunicationHandlerPtr handler, int enabled);
+
+/**
+ * @brief Resume an interrupted upload. Works like upload, including
+ *        authentication, but only the loads the TargetHardware didn't
+ *        confirm as completed are transmitted. If every load was already
+ *        confirmed, nothing is transmitted and the call succeeds.
+ *
+ *        Upload checkpointing must be enabled, see set_upload_checkpoint.
+ *
+ * @param[in] handler the communication handler.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult resume_upload(CommunicationHandlerPtr handler);
+
+/**
+ * @brief Set the retry policy of upload, resume_upload and asynchronous
+ *        uploads. Synchronous uploads wait for retries in the calling
+ *        thread. Asynchronous uploads running on the shared workers (see
+ *        set_async_upload_workers) give their worker back while waiting.
+ *        abort_upload cancels pending retries. By default nothing is
+ *        retried.
+ *
+ * @param[in] handler the communication handler.
+ * @param[in] policy the retry policy, NULL to disable retries.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult set_upload_retry_policy(
+    CommunicationHandlerPtr handler, const UploadRetryPolicy *policy);
+
 /**
  * @brief Abort upload operation.
  *
@@ -425,4 +1225,150 @@ CommunicationOperationResult upload(CommunicationHandlerPtr handler);
 CommunicationOperationResult abort_upload(
     CommunicationHandlerPtr handler, AbortSource abortSource);
 
+/*
+*******************************************************************************
+                            ASYNCHRONOUS UPLOAD OPERATION
+*******************************************************************************
+*/
+
+/**
+ * @brief Start upload operation without blocking the caller. Authentication
+ *        and transfer run in background and the returned operation can be
+ *        polled, waited on or watched through a file descriptor. Only one
+ *        asynchronous upload may be running for a handler at a time.
+ *
+ *        Callbacks registered for the handler are called from the
+ *        background context, and abort_upload may be used to abort it.
+ *        The operation must be released with upload_async_release.
+ *
+ * @param[in] handler the communication handler.
+ * @param[out] operation the asynchronous upload operation.
+ *
+ * @return COMMUNICATION_OPERATION_OK if the operation was started.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult upload_async(
+    CommunicationHandlerPtr handler, AsyncUploadPtr *operation);
+
+/**
+ * @brief Check the state of an asynchronous upload without blocking.
+ *
+ * @param[in] operation the asynchronous upload operation.
+ * @param[out] state the operation state.
+ * @param[out] result the upload result, only valid if state is
+ *                    ASYNC_UPLOAD_FINISHED. May be NULL.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult upload_async_poll(
+    AsyncUploadPtr operation, AsyncUploadState *state,
+    CommunicationOperationResult *result);
+
+/**
+ * @brief Wait for an asynchronous upload to finish.
+ *
+ * @param[in] operation the asynchronous upload operation.
+ * @param[in] timeout_ms maximum time to wait in milliseconds. A negative
+ *                       value waits until the operation finishes.
+ * @param[out] state the operation state when the wait returned.
+ * @param[out] result the upload result, only valid if state is
+ *                    ASYNC_UPLOAD_FINISHED. May be NULL.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult upload_async_wait(
+    AsyncUploadPtr operation, int timeout_ms, AsyncUploadState *state,
+    CommunicationOperationResult *result);
+
+/**
+ * @brief Get a file descriptor that becomes readable when the asynchronous
+ *        upload finishes. It can be added to poll/select/epoll so a single
+ *        thread can drive many uploads. The descriptor is owned by the
+ *        operation and is closed by upload_async_release.
+ *
+ * @param[in] operation the asynchronous upload operation.
+ * @param[out] fd the file descriptor.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult upload_async_get_fd(
+    AsyncUploadPtr operation, int *fd);
+
+/**
+ * @brief Release an asynchronous upload operation. If the operation is still
+ *        running, it's aborted and this function blocks until the upload
+ *        stops, which may take as long as the TargetHardware takes to
+ *        acknowledge the abort. It may be called while the handler is
+ *        being destroyed.
+ *
+ * @param[in] operation the asynchronous upload operation.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult upload_async_release(
+    AsyncUploadPtr *operation);
+
+/**
+ * @brief Set the number of threads shared by the asynchronous uploads of
+ *        all handlers in the process. With shared workers, asynchronous
+ *        uploads wait in a queue until a worker is free, so the number of
+ *        upload threads doesn't grow with the number of handlers. The
+ *        default value is 0, which starts one thread per asynchronous upload.
+ *
+ *        Changing the number of workers doesn't wait for the uploads
+ *        already queued: extra workers stop once their current upload is
+ *        done, and uploads already queued still run on the shared workers,
+ *        even if they are disabled.
+ *
+ * @param[in] workers the number of shared workers, 0 to disable them.
+ *
+ * @return COMMUNICATION_OPERATION_OK if success.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult set_async_upload_workers(unsigned int workers);
+
+/*
+*******************************************************************************
+                              BATCH UPLOAD OPERATION
+*******************************************************************************
+*/
+
+/**
+ * @brief Upload to several TargetHardwares in parallel. This is a blocking
+ *        function that returns when all jobs have finished.
+ *
+ *        The given handler is used as a template: its TFTP ports,
+ *        certificate, authentication settings, upload settings and upload
+ *        callbacks (initialization response, status and file not available,
+ *        plain and typed) are copied to the handlers used internally to run
+ *        the jobs. The callbacks are called with the template handler.
+ *        Each concurrent upload uses its own DataLoader TFTP server: with
+ *        TFTP_DATALOADER_SERVER_PORT_AUTO each upload allocates its port,
+ *        otherwise ports starting at the handler's DataLoader port up to
+ *        port + max_concurrent_uploads - 1 are used, and they must all be
+ *        valid ports. Ports that can't be bound are skipped, running fewer
+ *        uploads at the same time.
+ *
+ * @param[in] handler the communication handler used as template.
+ * @param[in,out] jobs the upload jobs. The result of each job is written
+ *                     to its result field.
+ * @param[in] jobs_size the number of jobs.
+ * @param[in] max_concurrent_uploads maximum number of uploads running at
+ *                                   the same time.
+ * @param[in] callback the progress callback, may be NULL.
+ * @param[in] context the user context.
+ * @param[out] failed_jobs the number of jobs that failed. May be NULL.
+ *
+ * @return COMMUNICATION_OPERATION_OK if all jobs succeeded.
+ * @return COMMUNICATION_OPERATION_ERROR otherwise.
+ */
+CommunicationOperationResult upload_batch(
+    CommunicationHandlerPtr handler, UploadJob *jobs, size_t jobs_size,
+    size_t max_concurrent_uploads, upload_job_status_callback callback,
+    void *context, size_t *failed_jobs);
+
 #endif // ICOMMUNICATION_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include "AsyncUploadPool.h"
+
+#include <algorithm>
+
+AsyncUploadPool::~AsyncUploadPool()
+{
+    std::deque<Operation *> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        targetWorkers = 0;
+        abandoned.swap(queue);
+        queueCondition.notify_all();
+    }
+
+    // Waiters may release an operation as soon as it's done, so it's only
+    // marked done once it's finished.
+    for (auto operation : abandoned)
+    {
+        operation->abandon();
+    }
+
+    std::vector<std::thread> exitedThreads;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (auto operation : abandoned)
+        {
+            operation->queued = false;
+        }
+        doneCondition.notify_all();
+        exitCondition.wait(lock, [this]
+                           { return liveWorkers == 0; });
+        exitedThreads.swap(exited);
+    }
+    for (auto &thread : exitedThreads)
+    {
+        thread.join();
+    }
+}
+
+void AsyncUploadPool::setWorkers(unsigned int workers)
+{
+    std::vector<std::thread> exitedThreads;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        targetWorkers = workers;
+        for (; liveWorkers < targetWorkers; ++liveWorkers)
+        {
+            std::thread thread(&AsyncUploadPool::run, this);
+            std::thread::id id = thread.get_id();
+            threads[id] = std::move(thread);
+        }
+        // Extra workers check whether they must retire
+        queueCondition.notify_all();
+        exitedThreads.swap(exited);
+    }
+    for (auto &thread : exitedThreads)
+    {
+        thread.join();
+    }
+}
+
+bool AsyncUploadPool::submit(Operation *operation)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (targetWorkers == 0)
+    {
+        return false;
+    }
+    operation->queued = true;
+    operation->retryAt = std::chrono::steady_clock::time_point();
+    queue.push_back(operation);
+    queueCondition.notify_one();
+    return true;
+}
+
+void AsyncUploadPool::wait(Operation *operation)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCondition.wait(lock, [operation]
+                       { return !operation->queued; });
+}
+
+size_t AsyncUploadPool::queued()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.size();
+}
+
+void AsyncUploadPool::wake()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    queueCondition.notify_all();
+}
+
+// Must be called with the pool lock held. Queued operations are run by the
+// last worker before it retires.
+bool AsyncUploadPool::mustRetire()
+{
+    return liveWorkers > targetWorkers &&
+           (targetWorkers > 0 || liveWorkers > 1 || queue.empty());
+}
+
+// Must be called with the pool lock held, by the retiring worker.
+void AsyncUploadPool::retire()
+{
+    auto thread = threads.find(std::this_thread::get_id());
+    exited.push_back(std::move(thread->second));
+    threads.erase(thread);
+    liveWorkers--;
+    exitCondition.notify_all();
+}
+
+void AsyncUploadPool::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        if (mustRetire())
+        {
+            retire();
+            return;
+        }
+        if (queue.empty())
+        {
+            queueCondition.wait(lock);
+            continue;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        auto next = queue.begin();
+        auto nextRetryAt = (*next)->retryAt;
+        for (; next != queue.end(); ++next)
+        {
+            if ((*next)->retryAt <= now || (*next)->isCancelled())
+            {
+                break;
+            }
+            nextRetryAt = std::min(nextRetryAt, (*next)->retryAt);
+        }
+        if (next == queue.end())
+        {
+            queueCondition.wait_until(lock, nextRetryAt);
+            continue;
+        }
+        Operation *operation = *next;
+        queue.erase(next);
+
+        lock.unlock();
+        std::chrono::steady_clock::time_point retryAt;
+        bool finished = operation->step(&retryAt);
+        lock.lock();
+
+        if (!finished && stopping)
+        {
+            lock.unlock();
+            operation->abandon();
+            lock.lock();
+            finished = true;
+        }
+
+        if (finished)
+        {
+            operation->queued = false;
+            doneCondition.notify_all();
+        }
+        else
+        {
+            operation->retryAt = retryAt;
+            queue.push_back(operation);
+            queueCondition.notify_one();
+        }
+    }
+}
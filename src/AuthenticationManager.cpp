@@ -1,18 +1,34 @@
 #include "AuthenticationManager.h"
+#include "Trace.h"
+#include "WorkerPool.h"
 #include <cjson/cJSON.h>
 #include <gcrypt.h>
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
 
 // If you change here, remember to change on BLModule
 // (BLAuthenticator) as well.
 #define KEY_SIZE 2048           // 2048 bits    
 #define DATA_SIZE_FIELD_SIZE 4
 
+// Authenticated sessions shared by all AuthenticationManagers in the process,
+// keyed by session key and holding the session expiration time.
+static std::mutex sessionsMutex;
+static std::unordered_map<std::string, std::chrono::steady_clock::time_point> sessions;
+
 AuthenticationManager::AuthenticationManager()
 {
-    cryptoContext = nullptr;
+    cryptoContext = new CryptoContext();
+    sessionTtlS = 0;
+    encryptionWorkers = 1;
+    ciphertextFormat = CIPHERTEXT_FORMAT_ADVANCED;
+    encryptionTimeUs = 0;
 
     authenticator = std::unique_ptr<AuthenticationDataLoader>(new AuthenticationDataLoader());
     authenticator->registerAuthenticationInitializationResponseCallback(
@@ -29,6 +45,7 @@ AuthenticationManager::~AuthenticationManager()
     {
         authenticator.reset();
     }
+    delete cryptoContext;
 }
 
 CommunicationOperationResult AuthenticationManager::setTftpDataLoaderServerPort(
@@ -51,6 +68,7 @@ CommunicationOperationResult AuthenticationManager::setTargetHardwareId(
     const char *targetHardwareId)
 {
     std::string targetHardwareIdStr(targetHardwareId);
+    this->targetHardwareId = targetHardwareIdStr;
     return authenticator->setTargetHardwareId(targetHardwareIdStr) == AuthenticationOperationResult::AUTHENTICATION_OPERATION_OK
                ? COMMUNICATION_OPERATION_OK
                : COMMUNICATION_OPERATION_ERROR;
@@ -60,6 +78,7 @@ CommunicationOperationResult AuthenticationManager::setTargetHardwarePosition(
     const char *targetHardwarePosition)
 {
     std::string targetHardwarePositionStr(targetHardwarePosition);
+    this->targetHardwarePosition = targetHardwarePositionStr;
     return authenticator->setTargetHardwarePosition(targetHardwarePositionStr) == AuthenticationOperationResult::AUTHENTICATION_OPERATION_OK
                ? COMMUNICATION_OPERATION_OK
                : COMMUNICATION_OPERATION_ERROR;
@@ -69,14 +88,59 @@ CommunicationOperationResult AuthenticationManager::setTargetHardwareIp(
     const char *targetHardwareIp)
 {
     std::string targetHardwareIpStr(targetHardwareIp);
+    this->targetHardwareIp = targetHardwareIpStr;
     return authenticator->setTargetHardwareIp(targetHardwareIpStr) == AuthenticationOperationResult::AUTHENTICATION_OPERATION_OK
                ? COMMUNICATION_OPERATION_OK
                : COMMUNICATION_OPERATION_ERROR;
 }
 
+/*
+ * SHA-256 of the file content, hex encoded.
+ */
+static bool fileFingerprint(const std::string &path, std::string &fingerprint)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    gcry_md_hd_t md;
+    if (gcry_md_open(&md, GCRY_MD_SHA256, 0))
+    {
+        fclose(fp);
+        return false;
+    }
+
+    unsigned char buffer[4096];
+    size_t bytesRead;
+    while ((bytesRead = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        gcry_md_write(md, buffer, bytesRead);
+    }
+    fclose(fp);
+
+    std::stringstream digestHex;
+    unsigned char *digest = gcry_md_read(md, GCRY_MD_SHA256);
+    for (unsigned int i = 0; i < gcry_md_get_algo_dlen(GCRY_MD_SHA256); ++i)
+    {
+        digestHex << std::hex << std::setw(2) << std::setfill('0') << (int)digest[i];
+    }
+    gcry_md_close(md);
+
+    fingerprint = digestHex.str();
+    return true;
+}
+
 CommunicationOperationResult AuthenticationManager::setCertificate(
     Certificate certificate)
 {
+    certificatePath = std::string(certificate.certificatePath);
+    certificateFingerprint.clear();
+    if (sessionTtlS > 0)
+    {
+        fileFingerprint(certificatePath, certificateFingerprint);
+    }
     std::vector<AuthenticationLoad> loadList;
     loadList.clear();
     loadList.push_back(std::make_tuple(std::string(certificate.certificatePath), "0"));
@@ -86,6 +150,199 @@ CommunicationOperationResult AuthenticationManager::setCertificate(
     return COMMUNICATION_OPERATION_OK;
 }
 
+CommunicationOperationResult AuthenticationManager::setSessionTtl(
+    unsigned int ttlS)
+{
+    sessionTtlS = ttlS;
+    return COMMUNICATION_OPERATION_OK;
+}
+
+uint64_t AuthenticationManager::takeEncryptionTimeUs()
+{
+    return encryptionTimeUs.exchange(0);
+}
+
+CommunicationOperationResult AuthenticationManager::setEncryptionWorkers(
+    unsigned int workers)
+{
+    encryptionWorkers = workers;
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult AuthenticationManager::setCiphertextFormat(
+    CiphertextFormat format)
+{
+    if (format != CIPHERTEXT_FORMAT_ADVANCED &&
+        format != CIPHERTEXT_FORMAT_CANONICAL &&
+        format != CIPHERTEXT_FORMAT_RAW)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    ciphertextFormat = format;
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult AuthenticationManager::invalidateSession()
+{
+    std::string key;
+    if (!getSessionKey(key))
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    std::lock_guard<std::mutex> lock(sessionsMutex);
+    sessions.erase(key);
+    return COMMUNICATION_OPERATION_OK;
+}
+
+bool AuthenticationManager::getSessionKey(std::string &key)
+{
+    // The certificate may not be available yet when it's set.
+    if (certificateFingerprint.empty() &&
+        !fileFingerprint(certificatePath, certificateFingerprint))
+    {
+        return false;
+    }
+
+    key = targetHardwareId + "|" + targetHardwarePosition + "|" +
+          targetHardwareIp + "|" + certificateFingerprint;
+    return true;
+}
+
+bool AuthenticationManager::readHexContent(FILE *fp, std::string &hexContent)
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+
+    if (fseek(fp, 0, SEEK_END) != 0)
+    {
+        return false;
+    }
+    long fileSize = ftell(fp);
+    if (fileSize < 0 || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        return false;
+    }
+
+    std::vector<unsigned char> content(fileSize);
+    if (fileSize > 0 && fread(content.data(), 1, fileSize, fp) != (size_t)fileSize)
+    {
+        return false;
+    }
+
+    hexContent.resize(content.size() * 2);
+    for (size_t i = 0; i < content.size(); ++i)
+    {
+        hexContent[2 * i] = hexDigits[content[i] >> 4];
+        hexContent[2 * i + 1] = hexDigits[content[i] & 0x0F];
+    }
+    return true;
+}
+
+/*
+ * Encrypt a chunk of hex data with the public key. Returns the encrypted
+ * S-expression, or NULL on error.
+ */
+static gcry_sexp_t encryptChunk(
+    gcry_sexp_t publicKey,
+    const char *chunk)
+{
+    gcry_error_t error;
+    gcry_mpi_t r_mpi;
+    if ((error = gcry_mpi_scan(&r_mpi, GCRYMPI_FMT_HEX, chunk, 0, NULL)))
+    {
+        // printf("Error in gcry_mpi_scan() in encrypt(): %s\nSource: %s\n", gcry_strerror(error), gcry_strsource(error));
+        return NULL;
+    }
+
+    gcry_sexp_t data;
+    size_t erroff;
+    error = gcry_sexp_build(&data, &erroff, "(data (flags raw) (value %m))", r_mpi);
+    gcry_mpi_release(r_mpi);
+    if (error)
+    {
+        // printf("Error in gcry_sexp_build() in encrypt() at %ld: %s\nSource: %s\n", erroff, gcry_strerror(error), gcry_strsource(error));
+        return NULL;
+    }
+
+    gcry_sexp_t r_ciph;
+    error = gcry_pk_encrypt(&r_ciph, data, publicKey);
+    gcry_sexp_release(data);
+    if (error)
+    {
+        // printf("Error in gcry_pk_encrypt(): %s\nSource: %s\n", gcry_strerror(error), gcry_strsource(error));
+        return NULL;
+    }
+
+    return r_ciph;
+}
+
+/*
+ * Size of an encrypted chunk serialized in the given format, without the
+ * size field. The raw format is the RSA output "a" as a big-endian number
+ * padded to the key size, so every chunk has the same size.
+ */
+static size_t ciphertextSize(gcry_sexp_t r_ciph, CiphertextFormat format)
+{
+    switch (format)
+    {
+    case CIPHERTEXT_FORMAT_RAW:
+        return KEY_SIZE / 8;
+    case CIPHERTEXT_FORMAT_CANONICAL:
+        return gcry_sexp_sprint(r_ciph, GCRYSEXP_FMT_CANON, NULL, 0);
+    default:
+        return gcry_sexp_sprint(r_ciph, GCRYSEXP_FMT_ADVANCED, NULL, 0);
+    }
+}
+
+/*
+ * Serialize an encrypted chunk in the given format into buffer, which must
+ * have room for DATA_SIZE_FIELD_SIZE plus ciphertextSize bytes.
+ */
+static bool writeCiphertext(
+    gcry_sexp_t r_ciph,
+    CiphertextFormat format,
+    size_t size,
+    char *buffer)
+{
+    for (size_t j = 0, k = DATA_SIZE_FIELD_SIZE - 1; j < DATA_SIZE_FIELD_SIZE; j++, k--)
+    {
+        buffer[k] = ((size >> (j * 8)) & 0xFF);
+    }
+    char *payload = buffer + DATA_SIZE_FIELD_SIZE;
+
+    if (format != CIPHERTEXT_FORMAT_RAW)
+    {
+        return 0 != gcry_sexp_sprint(r_ciph, format == CIPHERTEXT_FORMAT_CANONICAL
+                                                 ? GCRYSEXP_FMT_CANON
+                                                 : GCRYSEXP_FMT_ADVANCED,
+                                     payload, size);
+    }
+
+    gcry_sexp_t a_sexp = gcry_sexp_find_token(r_ciph, "a", 0);
+    if (a_sexp == NULL)
+    {
+        return false;
+    }
+    gcry_mpi_t a_mpi = gcry_sexp_nth_mpi(a_sexp, 1, GCRYMPI_FMT_USG);
+    gcry_sexp_release(a_sexp);
+    if (a_mpi == NULL)
+    {
+        return false;
+    }
+
+    size_t written = 0;
+    bool serialized = !gcry_mpi_print(GCRYMPI_FMT_USG, (unsigned char *)payload, size,
+                                      &written, a_mpi);
+    gcry_mpi_release(a_mpi);
+    if (serialized && written < size)
+    {
+        size_t padding = size - written;
+        memmove(payload + padding, payload, written);
+        memset(payload, 0, padding);
+    }
+    return serialized;
+}
+
 AuthenticationOperationResult AuthenticationManager::loadPrepareCbk(
     std::string fileName,
     FILE **fp,
@@ -100,22 +357,14 @@ AuthenticationOperationResult AuthenticationManager::loadPrepareCbk(
     AuthenticationManager *thiz = (AuthenticationManager *)context;
 
     std::string hexFileContent;
-    fseek(*fp, 0, SEEK_SET);
-    while (!feof(*fp))
+    if (!readHexContent(*fp, hexFileContent))
     {
-        char hexChar[3];
-        unsigned char byte;
-        fread(&byte, 1, 1, *fp);
-        sprintf(hexChar, "%02X", byte);
-        hexFileContent += hexChar;
+        return AuthenticationOperationResult::AUTHENTICATION_OPERATION_ERROR;
     }
 
-    std::string asciiKey = "";
-    for (size_t i = 0; i < thiz->cryptoContext->key.length(); i += 2)
+    if (thiz->cryptoContext->publicKey == NULL)
     {
-        std::string part = thiz->cryptoContext->key.substr(i, 2);
-        char ch = stoul(part, nullptr, 16);
-        asciiKey += ch;
+        return AuthenticationOperationResult::AUTHENTICATION_OPERATION_ERROR;
     }
 
     /*
@@ -125,111 +374,183 @@ AuthenticationOperationResult AuthenticationManager::loadPrepareCbk(
      * and the chunk data, so the chunk size is 
      * KEY_SIZE_BYTES - 2 - DATA_SIZE_FIELD_SIZE.
      */
+    TRACE_SCOPE("encrypt certificate");
+    auto encryptionStart = std::chrono::steady_clock::now();
     thiz->cryptoContext->cypheredDataSize = 0;
-    if (thiz->cryptoContext->cypheredData != NULL)
+    size_t maxChunkSize = (KEY_SIZE / 8) - 2 - DATA_SIZE_FIELD_SIZE;
+    size_t nchunks = (hexFileContent.length() / maxChunkSize) + 1;
+    std::vector<gcry_sexp_t> cypheredChunks(nchunks, NULL);
+
+    // Chunks are independent, so workers take the next pending chunk until
+    // all of them are encrypted. The calling thread works as well.
+    std::atomic<size_t> nextChunk(0);
+    std::atomic<bool> encryptionFailed(false);
+    gcry_sexp_t publicKey = thiz->cryptoContext->publicKey;
+    auto encryptChunks = [&]()
     {
-        free(thiz->cryptoContext->cypheredData);
-        thiz->cryptoContext->cypheredData = NULL;
+        TRACE_SCOPE("encrypt chunks");
+        std::vector<char> chunk(maxChunkSize + 1);
+        size_t i;
+        while (!encryptionFailed && (i = nextChunk++) < nchunks)
+        {
+            size_t offset = i * maxChunkSize;
+            size_t chunkSize = std::min(maxChunkSize, hexFileContent.length() - offset);
+            memcpy(chunk.data(), hexFileContent.data() + offset, chunkSize);
+            chunk[chunkSize] = '\0';
+
+            cypheredChunks[i] = encryptChunk(publicKey, chunk.data());
+            if (cypheredChunks[i] == NULL)
+            {
+                encryptionFailed = true;
+            }
+        }
+    };
+
+    // Helpers come from the pool shared by every handler, so concurrent
+    // authentications don't multiply the threads.
+    unsigned int workers = thiz->encryptionWorkers;
+    if (workers == 0)
+    {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers = (unsigned int)std::min((size_t)workers, nchunks);
+    WorkerPool::getInstance().run(encryptChunks, workers - 1);
+
+    // Serialize chunks straight into the output buffer, which is kept
+    // between calls and only grows when a larger buffer is needed.
+    CiphertextFormat format = thiz->cryptoContext->ciphertextFormat;
+    std::vector<size_t> cypheredChunkSize(nchunks, 0);
+    size_t cypheredDataSize = 0;
+    for (size_t i = 0; i < nchunks && !encryptionFailed; ++i)
+    {
+        cypheredChunkSize[i] = ciphertextSize(cypheredChunks[i], format);
+        cypheredDataSize += DATA_SIZE_FIELD_SIZE + cypheredChunkSize[i];
     }
-    size_t maxChunkSize = (KEY_SIZE / 8) - 2 - DATA_SIZE_FIELD_SIZE;
-    uint8_t nchunks = (hexFileContent.length() / maxChunkSize) + 1;
-    char **cypheredChunkData = (char **)malloc(sizeof(char *) * (nchunks));
 
-    for (int i = 0; i < nchunks; ++i)
+    if (!encryptionFailed && !thiz->cryptoContext->reserve(cypheredDataSize))
     {
-        std::string chunk = hexFileContent.substr(i*maxChunkSize, maxChunkSize);
+        // printf("realloc(%ld) failed in loadPrepareCbk()!\n", cypheredDataSize);
+        encryptionFailed = true;
+    }
 
-        gcry_error_t error;
-        gcry_mpi_t r_mpi;
-        if ((error = gcry_mpi_scan(&r_mpi, GCRYMPI_FMT_HEX, chunk.c_str(), 0, NULL)))
+    for (size_t i = 0, j = 0; i < nchunks; ++i)
+    {
+        if (!encryptionFailed)
         {
-            // printf("Error in gcry_mpi_scan() in encrypt(): %s\nSource: %s\n", gcry_strerror(error), gcry_strsource(error));
-            return AuthenticationOperationResult::AUTHENTICATION_OPERATION_ERROR;
+            if (writeCiphertext(cypheredChunks[i], format, cypheredChunkSize[i],
+                                thiz->cryptoContext->cypheredData + j))
+            {
+                j += DATA_SIZE_FIELD_SIZE + cypheredChunkSize[i];
+            }
+            else
+            {
+                encryptionFailed = true;
+            }
         }
+        gcry_sexp_release(cypheredChunks[i]);
+    }
 
-        gcry_sexp_t data;
-        size_t erroff;
-        if ((error = gcry_sexp_build(&data, &erroff, "(data (flags raw) (value %m))", r_mpi)))
-        {
-            // printf("Error in gcry_sexp_build() in encrypt() at %ld: %s\nSource: %s\n", erroff, gcry_strerror(error), gcry_strsource(error));
-            return AuthenticationOperationResult::AUTHENTICATION_OPERATION_ERROR;
-        }
+    if (encryptionFailed)
+    {
+        return AuthenticationOperationResult::AUTHENTICATION_OPERATION_ERROR;
+    }
+    thiz->cryptoContext->cypheredDataSize = cypheredDataSize;
+    thiz->encryptionTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(
+                                  std::chrono::steady_clock::now() - encryptionStart)
+                                  .count();
 
-        gcry_sexp_t public_sexp;
-        gcry_sexp_t r_ciph;
-        if ((error = gcry_sexp_new(&public_sexp, asciiKey.c_str(), asciiKey.size(), 1)))
-        {
-            // printf("Error in sexp_new(%s): %s\nSource: %s\n", asciiKey.c_str(), gcry_strerror(error), gcry_strsource(error));
-            return AuthenticationOperationResult::AUTHENTICATION_OPERATION_ERROR;
-        }
-        if ((error = gcry_pk_encrypt(&r_ciph, data, public_sexp)))
-        {
-            // printf("Error in gcry_pk_encrypt(): %s\nSource: %s\n", gcry_strerror(error), gcry_strsource(error));
-            return AuthenticationOperationResult::AUTHENTICATION_OPERATION_ERROR;
-        }
+    // Move file pointer to encrypted data
+    fclose(*fp);
+    *fp = fmemopen(thiz->cryptoContext->cypheredData, thiz->cryptoContext->cypheredDataSize, "r");
+    *bufferSize = thiz->cryptoContext->cypheredDataSize;
 
-        size_t cypheredChunkSize = DATA_SIZE_FIELD_SIZE;
-        cypheredChunkSize += gcry_sexp_sprint(r_ciph, GCRYSEXP_FMT_ADVANCED, NULL, 0);
+    return AuthenticationOperationResult::AUTHENTICATION_OPERATION_OK;
+}
 
-        cypheredChunkData[i] = (char *)gcry_malloc(cypheredChunkSize);
-        if (cypheredChunkData[i] == NULL)
-        {
-            // printf("gcry_malloc(%ld) returned NULL in sexp_string()!\n", thiz->cryptoContext->cypheredDataSize);
-            return AuthenticationOperationResult::AUTHENTICATION_OPERATION_ERROR;
-        }
-        size_t effectiveCypheredChunkSize = cypheredChunkSize - DATA_SIZE_FIELD_SIZE;
-        for (size_t j = 0, k = DATA_SIZE_FIELD_SIZE - 1; j < DATA_SIZE_FIELD_SIZE; j++, k--)
-        {
-            cypheredChunkData[i][k] = ((effectiveCypheredChunkSize >> (j * 8)) & 0xFF);
-        }
-        if (0 == gcry_sexp_sprint(r_ciph, GCRYSEXP_FMT_ADVANCED,
-                                  cypheredChunkData[i] + DATA_SIZE_FIELD_SIZE,
-                                  effectiveCypheredChunkSize))
-        {
-            // printf("gcry_sexp_sprint() lies!\n");
-            return AuthenticationOperationResult::AUTHENTICATION_OPERATION_ERROR;
-        }
+static const char *ciphertextFormatName(CiphertextFormat format)
+{
+    switch (format)
+    {
+    case CIPHERTEXT_FORMAT_CANONICAL:
+        return "canonical";
+    case CIPHERTEXT_FORMAT_RAW:
+        return "raw";
+    default:
+        return "advanced";
+    }
+}
 
-        thiz->cryptoContext->cypheredDataSize += cypheredChunkSize;
+static int hexValue(char hexChar)
+{
+    if (hexChar >= '0' && hexChar <= '9')
+    {
+        return hexChar - '0';
+    }
+    if (hexChar >= 'A' && hexChar <= 'F')
+    {
+        return hexChar - 'A' + 10;
     }
+    if (hexChar >= 'a' && hexChar <= 'f')
+    {
+        return hexChar - 'a' + 10;
+    }
+    return -1;
+}
 
-    // Merge chunks into a single buffer
-    thiz->cryptoContext->cypheredData = (char *)malloc(thiz->cryptoContext->cypheredDataSize);
-    if (thiz->cryptoContext->cypheredData == NULL)
+bool AuthenticationManager::CryptoContext::reserve(size_t size)
+{
+    if (cypheredData != NULL && size <= cypheredDataCapacity)
     {
-        // printf("malloc(%ld) returned NULL in sexp_string()!\n", thiz->cryptoContext->cypheredDataSize);
-        return AuthenticationOperationResult::AUTHENTICATION_OPERATION_ERROR;
+        return true;
+    }
+
+    char *newCypheredData = (char *)realloc(cypheredData, size);
+    if (newCypheredData == NULL)
+    {
+        return false;
+    }
+    cypheredData = newCypheredData;
+    cypheredDataCapacity = size;
+    return true;
+}
+
+bool AuthenticationManager::CryptoContext::setKey(const std::string &hexKey)
+{
+    if (publicKey != NULL && hexKey == key)
+    {
+        return true;
+    }
+
+    if (hexKey.length() % 2 != 0)
+    {
+        return false;
     }
 
-    for (int i = 0, j = 0; i < nchunks; ++i)
+    std::string asciiKey(hexKey.length() / 2, '\0');
+    for (size_t i = 0; i < asciiKey.length(); ++i)
     {
-        //Read chunk size
-        size_t cypheredChunkSize = 0;
-        for (size_t k = 0; k < DATA_SIZE_FIELD_SIZE; k++)
+        int high = hexValue(hexKey[2 * i]);
+        int low = hexValue(hexKey[2 * i + 1]);
+        if (high < 0 || low < 0)
         {
-            // printf("\n%02x", cypheredChunkData[i][k]);
-            cypheredChunkSize <<= 8;
-            cypheredChunkSize |= cypheredChunkData[i][k];
+            return false;
         }
-        cypheredChunkSize += DATA_SIZE_FIELD_SIZE;
-        // printf("\ncypheredChunkSize: %ld\n", cypheredChunkSize);
-        memcpy(thiz->cryptoContext->cypheredData + j, cypheredChunkData[i], cypheredChunkSize);
-        j += cypheredChunkSize;
+        asciiKey[i] = (char)((high << 4) | low);
     }
 
-    //Free chunks
-    for (int i = 0; i < nchunks; ++i)
+    gcry_sexp_t newPublicKey;
+    if (gcry_sexp_new(&newPublicKey, asciiKey.c_str(), asciiKey.size(), 1))
     {
-        free(cypheredChunkData[i]);
+        return false;
     }
-    free(cypheredChunkData);
 
-    // Move file pointer to encrypted data
-    fclose(*fp);
-    *fp = fmemopen(thiz->cryptoContext->cypheredData, thiz->cryptoContext->cypheredDataSize, "r");
-    *bufferSize = thiz->cryptoContext->cypheredDataSize;
-
-    return AuthenticationOperationResult::AUTHENTICATION_OPERATION_OK;
+    if (publicKey != NULL)
+    {
+        gcry_sexp_release(publicKey);
+    }
+    publicKey = newPublicKey;
+    key = hexKey;
+    return true;
 }
 
 AuthenticationOperationResult
@@ -263,9 +584,31 @@ AuthenticationManager::authenticationInitializationResponseCbk(
     }
 
     AuthenticationManager *thiz = (AuthenticationManager *)context;
-    thiz->cryptoContext->key = std::string(cryptographicKey->valuestring);
+    bool keyParsed = cryptographicKey->valuestring != NULL &&
+                     thiz->cryptoContext->setKey(cryptographicKey->valuestring);
+
+    // Compact formats are only used if the TargetHardware lists them,
+    // older TargetHardwares only understand the advanced format.
+    thiz->cryptoContext->ciphertextFormat = CIPHERTEXT_FORMAT_ADVANCED;
+    cJSON *ciphertextFormats = cJSON_GetObjectItem(root, "ciphertextFormats");
+    if (ciphertextFormats != NULL && thiz->ciphertextFormat != CIPHERTEXT_FORMAT_ADVANCED)
+    {
+        const char *preferredFormat = ciphertextFormatName(thiz->ciphertextFormat);
+        for (int i = 0; i < cJSON_GetArraySize(ciphertextFormats); ++i)
+        {
+            cJSON *ciphertextFormat = cJSON_GetArrayItem(ciphertextFormats, i);
+            if (ciphertextFormat != NULL && ciphertextFormat->valuestring != NULL &&
+                strcmp(ciphertextFormat->valuestring, preferredFormat) == 0)
+            {
+                thiz->cryptoContext->ciphertextFormat = thiz->ciphertextFormat;
+                break;
+            }
+        }
+    }
+    cJSON_Delete(root);
 
-    return AuthenticationOperationResult::AUTHENTICATION_OPERATION_OK;
+    return keyParsed ? AuthenticationOperationResult::AUTHENTICATION_OPERATION_OK
+                     : AuthenticationOperationResult::AUTHENTICATION_OPERATION_ERROR;
 }
 
 CommunicationOperationResult
@@ -279,10 +622,31 @@ AuthenticationManager::registerCertificateNotAvailableCallback(
 
 CommunicationOperationResult AuthenticationManager::authenticate()
 {
+    TRACE_SCOPE("authenticate");
+    std::string sessionKey;
+    bool useSession = sessionTtlS > 0 && getSessionKey(sessionKey);
+    if (useSession)
+    {
+        std::lock_guard<std::mutex> lock(sessionsMutex);
+        auto session = sessions.find(sessionKey);
+        if (session != sessions.end())
+        {
+            if (std::chrono::steady_clock::now() < session->second)
+            {
+                return COMMUNICATION_OPERATION_OK;
+            }
+            sessions.erase(session);
+        }
+    }
 
-    cryptoContext = new CryptoContext();
     AuthenticationOperationResult result = authenticator->authenticate();
-    delete cryptoContext;
+
+    if (useSession && result == AuthenticationOperationResult::AUTHENTICATION_OPERATION_OK)
+    {
+        std::lock_guard<std::mutex> lock(sessionsMutex);
+        sessions[sessionKey] = std::chrono::steady_clock::now() +
+                               std::chrono::seconds(sessionTtlS);
+    }
 
     return (result == AuthenticationOperationResult::AUTHENTICATION_OPERATION_OK)
                ? COMMUNICATION_OPERATION_OK
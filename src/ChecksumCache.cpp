@@ -0,0 +1,189 @@
+#include "ChecksumCache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <gcrypt.h>
+
+#define CHECKSUM_CACHE_READ_SIZE (1024 * 1024)
+#define CHECKSUM_CACHE_MAX_ENTRIES 256
+
+ChecksumCache::Entry::Entry()
+{
+    size = 0;
+    mtime = 0;
+    mtimeNs = 0;
+    lastUse = 0;
+    checksumsValid = false;
+    crc32 = 0;
+    memset(sha256, 0, sizeof(sha256));
+}
+
+static bool sameFile(const struct stat &fileStat, size_t size, time_t mtime, long mtimeNs)
+{
+    return S_ISREG(fileStat.st_mode) && (size_t)fileStat.st_size == size &&
+           fileStat.st_mtim.tv_sec == mtime && fileStat.st_mtim.tv_nsec == mtimeNs;
+}
+
+ChecksumCache::ChecksumCache()
+{
+    useCount = 0;
+}
+
+ChecksumCache &ChecksumCache::getInstance()
+{
+    static ChecksumCache instance;
+    return instance;
+}
+
+bool ChecksumCache::computeChecksums(Entry &entry, const std::atomic<bool> *cancel)
+{
+    int fd = open(entry.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    // libgcrypt uses CPU acceleration for both digests when available.
+    gcry_md_hd_t md;
+    if (gcry_md_open(&md, GCRY_MD_CRC32, 0))
+    {
+        close(fd);
+        return false;
+    }
+    if (gcry_md_enable(md, GCRY_MD_SHA256))
+    {
+        gcry_md_close(md);
+        close(fd);
+        return false;
+    }
+
+    bool success = true;
+    size_t total = 0;
+    std::vector<unsigned char> buffer(CHECKSUM_CACHE_READ_SIZE);
+    while (true)
+    {
+        if (cancel != NULL && cancel->load())
+        {
+            success = false;
+            break;
+        }
+        ssize_t bytesRead = read(fd, buffer.data(), buffer.size());
+        if (bytesRead < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytesRead <= 0)
+        {
+            success = bytesRead == 0;
+            break;
+        }
+        gcry_md_write(md, buffer.data(), (size_t)bytesRead);
+        total += (size_t)bytesRead;
+    }
+
+    // A file rewritten while it was read doesn't match this entry anymore.
+    struct stat fileStat;
+    success = success && total == entry.size && fstat(fd, &fileStat) == 0 &&
+              sameFile(fileStat, entry.size, entry.mtime, entry.mtimeNs);
+    close(fd);
+
+    if (success)
+    {
+        unsigned char *crcDigest = gcry_md_read(md, GCRY_MD_CRC32);
+        entry.crc32 = ((uint32_t)crcDigest[0] << 24) | ((uint32_t)crcDigest[1] << 16) |
+                      ((uint32_t)crcDigest[2] << 8) | (uint32_t)crcDigest[3];
+        memcpy(entry.sha256, gcry_md_read(md, GCRY_MD_SHA256), SHA256_SIZE);
+    }
+    gcry_md_close(md);
+    return success;
+}
+
+bool ChecksumCache::getChecksums(const std::string &path, uint32_t *crc32,
+                                 unsigned char *sha256,
+                                 const std::atomic<bool> *cancel)
+{
+    struct stat fileStat;
+    if (stat(path.c_str(), &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
+    {
+        return false;
+    }
+
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(path);
+        if (it != entries.end() &&
+            sameFile(fileStat, it->second->size, it->second->mtime, it->second->mtimeNs))
+        {
+            entry = it->second;
+            entry->lastUse = ++useCount;
+        }
+        else
+        {
+            entry = std::make_shared<Entry>();
+            entry->path = path;
+            entry->size = (size_t)fileStat.st_size;
+            entry->mtime = fileStat.st_mtim.tv_sec;
+            entry->mtimeNs = fileStat.st_mtim.tv_nsec;
+            entry->lastUse = ++useCount;
+            entries[path] = entry;
+            evict();
+        }
+    }
+
+    // The cache lock isn't held while a file is streamed, only the entry's.
+    std::lock_guard<std::mutex> lock(entry->checksumsMutex);
+    if (!entry->checksumsValid)
+    {
+        entry->checksumsValid = computeChecksums(*entry, cancel);
+        if (!entry->checksumsValid)
+        {
+            return false;
+        }
+    }
+
+    if (crc32 != NULL)
+    {
+        *crc32 = entry->crc32;
+    }
+    if (sha256 != NULL)
+    {
+        memcpy(sha256, entry->sha256, SHA256_SIZE);
+    }
+    return true;
+}
+
+void ChecksumCache::evict()
+{
+    if (entries.size() <= CHECKSUM_CACHE_MAX_ENTRIES)
+    {
+        return;
+    }
+
+    // A quarter of the entries goes at once, so a full cache isn't walked
+    // on every miss.
+    std::vector<uint64_t> uses;
+    uses.reserve(entries.size());
+    for (auto &it : entries)
+    {
+        uses.push_back(it.second->lastUse);
+    }
+    size_t dropped = entries.size() / 4;
+    std::nth_element(uses.begin(), uses.begin() + dropped, uses.end());
+    uint64_t oldestKept = uses[dropped];
+    for (auto it = entries.begin(); it != entries.end();)
+    {
+        it = it->second->lastUse < oldestKept ? entries.erase(it) : std::next(it);
+    }
+}
+
+size_t ChecksumCache::size()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
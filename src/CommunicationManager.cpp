@@ -1,9 +1,18 @@
 #include "CommunicationManager.h"
+#include "ChecksumCache.h"
+#include "LoadUploadStatusFileARINC615A.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <string.h>
+#include <sys/stat.h>
 
 CommunicationManager::CommunicationManager()
 {
     finder = std::unique_ptr<FindARINC615A>(new FindARINC615A());
     uploader = std::unique_ptr<UploadDataLoaderARINC615A>(new UploadDataLoaderARINC615A());
+    loadListChanged = false;
+    uploadBytes = 0;
 }
 
 CommunicationManager::~CommunicationManager()
@@ -67,6 +76,7 @@ CommunicationOperationResult CommunicationManager::find()
 CommunicationOperationResult CommunicationManager::setTargetHardwareId(
     const char *targetHardwareId)
 {
+    resetCompletedLoads();
     std::string targetHardwareIdStr(targetHardwareId);
     return uploader->setTargetHardwareId(targetHardwareIdStr) == UploadOperationResult::UPLOAD_OPERATION_OK
                ? COMMUNICATION_OPERATION_OK
@@ -76,6 +86,7 @@ CommunicationOperationResult CommunicationManager::setTargetHardwareId(
 CommunicationOperationResult CommunicationManager::setTargetHardwarePosition(
     const char *targetHardwarePosition)
 {
+    resetCompletedLoads();
     std::string targetHardwarePositionStr(targetHardwarePosition);
     return uploader->setTargetHardwarePosition(targetHardwarePositionStr) == UploadOperationResult::UPLOAD_OPERATION_OK
                ? COMMUNICATION_OPERATION_OK
@@ -85,25 +96,135 @@ CommunicationOperationResult CommunicationManager::setTargetHardwarePosition(
 CommunicationOperationResult CommunicationManager::setTargetHardwareIp(
     const char *targetHardwareIp)
 {
+    resetCompletedLoads();
     std::string targetHardwareIpStr(targetHardwareIp);
     return uploader->setTargetHardwareIp(targetHardwareIpStr) == UploadOperationResult::UPLOAD_OPERATION_OK
                ? COMMUNICATION_OPERATION_OK
                : COMMUNICATION_OPERATION_ERROR;
 }
 
+static bool isValidLoad(const Load *load)
+{
+    return load != NULL &&
+           strnlen(load->loadName, MAX_NAME_SIZE) > 0 &&
+           strnlen(load->loadName, MAX_NAME_SIZE) < MAX_NAME_SIZE &&
+           strnlen(load->partNumber, MAX_NAME_SIZE) < MAX_NAME_SIZE;
+}
+
 CommunicationOperationResult CommunicationManager::setLoadList(
     Load *load_list, size_t load_list_size)
 {
-    std::vector<ArincLoad> loadList;
-    loadList.clear();
+    if (load_list == NULL && load_list_size > 0)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
     for (size_t i = 0; i < load_list_size; i++)
     {
-        loadList.push_back(std::make_tuple(std::string(load_list[i].loadName),
-                                           std::string(load_list[i].partNumber)));
+        if (!isValidLoad(&load_list[i]))
+        {
+            return COMMUNICATION_OPERATION_ERROR;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(loadListMutex);
+        loadList.clear();
+        loadList.reserve(load_list_size);
+        for (size_t i = 0; i < load_list_size; i++)
+        {
+            loadList.push_back(std::make_tuple(std::string(load_list[i].loadName),
+                                               std::string(load_list[i].partNumber)));
+        }
+        completedLoads.assign(loadList.size(), false);
+    }
+    loadListChanged = true;
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult CommunicationManager::addLoad(const Load *load)
+{
+    if (!isValidLoad(load))
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    {
+        std::lock_guard<std::mutex> lock(loadListMutex);
+        loadList.push_back(std::make_tuple(std::string(load->loadName),
+                                           std::string(load->partNumber)));
+        completedLoads.assign(loadList.size(), false);
+    }
+    loadListChanged = true;
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult CommunicationManager::removeLoad(const char *loadName)
+{
+    if (loadName == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    size_t previousSize = loadList.size();
+    {
+        std::lock_guard<std::mutex> lock(loadListMutex);
+        loadList.erase(std::remove_if(loadList.begin(), loadList.end(),
+                                      [loadName](const ArincLoad &load)
+                                      { return std::get<0>(load) == loadName; }),
+                       loadList.end());
+        completedLoads.assign(loadList.size(), false);
+    }
+    if (loadList.size() == previousSize)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    loadListChanged = true;
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult CommunicationManager::clearLoadList()
+{
+    {
+        std::lock_guard<std::mutex> lock(loadListMutex);
+        loadList.clear();
+        completedLoads.clear();
+    }
+    loadListChanged = true;
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult CommunicationManager::getLoadChecksums(
+    LoadChecksum *checksums, size_t *checksumsSize)
+{
+    if (checksumsSize == NULL || (checksums == NULL && *checksumsSize > 0))
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    std::vector<ArincLoad> loads;
+    {
+        std::lock_guard<std::mutex> lock(loadListMutex);
+        loads = loadList;
+    }
+
+    size_t capacity = *checksumsSize;
+    *checksumsSize = loads.size();
+    if (capacity < loads.size())
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    // Checksums are only computed when asked for, the transfer doesn't use
+    // them. Files already checksummed by any handler come from the cache.
+    for (size_t i = 0; i < loads.size(); ++i)
+    {
+        strncpy(checksums[i].loadName, std::get<0>(loads[i]).c_str(), MAX_NAME_SIZE - 1);
+        checksums[i].loadName[MAX_NAME_SIZE - 1] = '\0';
+        if (!ChecksumCache::getInstance().getChecksums(std::get<0>(loads[i]),
+                                                       &checksums[i].crc32,
+                                                       checksums[i].sha256))
+        {
+            return COMMUNICATION_OPERATION_ERROR;
+        }
     }
-    return uploader->setLoadList(loadList) == UploadOperationResult::UPLOAD_OPERATION_OK
-               ? COMMUNICATION_OPERATION_OK
-               : COMMUNICATION_OPERATION_ERROR;
     return COMMUNICATION_OPERATION_OK;
 }
 
@@ -134,8 +255,117 @@ CommunicationManager::registerFileNotAvailableCallback(
                : COMMUNICATION_OPERATION_ERROR;
 }
 
+void CommunicationManager::resetCompletedLoads()
+{
+    std::lock_guard<std::mutex> lock(loadListMutex);
+    completedLoads.assign(loadList.size(), false);
+}
+
+void CommunicationManager::setLoadCompleted(
+    const char *headerFileName, const char *partNumber)
+{
+    // The header file name identifies a load, many loads may share a part
+    // number. The part number is only used when the TargetHardware didn't
+    // report the file name.
+    bool byFileName = headerFileName != NULL && headerFileName[0] != '\0';
+    if (!byFileName && (partNumber == NULL || partNumber[0] == '\0'))
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(loadListMutex);
+    for (size_t i = 0; i < loadList.size() && i < completedLoads.size(); ++i)
+    {
+        bool matches = false;
+        if (byFileName)
+        {
+            // The TargetHardware only knows the file name, not the local path.
+            const std::string &loadName = std::get<0>(loadList[i]);
+            matches = loadName.substr(loadName.find_last_of('/') + 1) == headerFileName;
+        }
+        else
+        {
+            matches = std::get<1>(loadList[i]) == partNumber;
+        }
+        if (matches)
+        {
+            completedLoads[i] = true;
+        }
+    }
+}
+
+static uint64_t loadFileSize(const std::string &path)
+{
+    struct stat fileStat;
+    if (stat(path.c_str(), &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
+    {
+        return 0;
+    }
+    return (uint64_t)fileStat.st_size;
+}
+
+uint64_t CommunicationManager::getUploadBytes()
+{
+    return uploadBytes;
+}
+
 CommunicationOperationResult CommunicationManager::upload()
 {
+    TRACE_SCOPE("transfer");
+    resetCompletedLoads();
+
+    // Sizes come from the file status, the transfer doesn't wait for the
+    // checksums.
+    uploadBytes = 0;
+    for (auto &load : loadList)
+    {
+        uploadBytes += loadFileSize(std::get<0>(load));
+    }
+
+    if (loadListChanged)
+    {
+        if (uploader->setLoadList(loadList) != UploadOperationResult::UPLOAD_OPERATION_OK)
+        {
+            return COMMUNICATION_OPERATION_ERROR;
+        }
+        loadListChanged = false;
+    }
+
+    return uploader->upload() == UploadOperationResult::UPLOAD_OPERATION_OK
+               ? COMMUNICATION_OPERATION_OK
+               : COMMUNICATION_OPERATION_ERROR;
+}
+
+CommunicationOperationResult CommunicationManager::resumeUpload()
+{
+    TRACE_SCOPE("resume transfer");
+    std::vector<ArincLoad> remainingLoads;
+    uploadBytes = 0;
+    {
+        std::lock_guard<std::mutex> lock(loadListMutex);
+        for (size_t i = 0; i < loadList.size(); ++i)
+        {
+            if (i >= completedLoads.size() || !completedLoads[i])
+            {
+                remainingLoads.push_back(loadList[i]);
+                uploadBytes += loadFileSize(std::get<0>(loadList[i]));
+            }
+        }
+    }
+
+    if (remainingLoads.empty() && !loadList.empty())
+    {
+        return COMMUNICATION_OPERATION_OK;
+    }
+
+    // The uploader gets the remaining loads only, so the full load list
+    // must be handed to it again on the next upload.
+    if (uploader->setLoadList(remainingLoads) != UploadOperationResult::UPLOAD_OPERATION_OK)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    loadListChanged = true;
+
     return uploader->upload() == UploadOperationResult::UPLOAD_OPERATION_OK
                ? COMMUNICATION_OPERATION_OK
                : COMMUNICATION_OPERATION_ERROR;
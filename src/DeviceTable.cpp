@@ -0,0 +1,255 @@
+#include "DeviceTable.h"
+
+#include <cjson/cJSON.h>
+
+#include <stdio.h>
+#include <unordered_set>
+
+static std::string jsonString(cJSON *object, const char *name)
+{
+    cJSON *item = cJSON_GetObjectItemCaseSensitive(object, name);
+    return item != NULL && item->valuestring != NULL ? item->valuestring : "";
+}
+
+static bool parseDevice(cJSON *json, DeviceTable::Device &device)
+{
+    cJSON *hardware = cJSON_GetObjectItemCaseSensitive(json, "hardware");
+    if (hardware == NULL)
+    {
+        return false;
+    }
+    device.mac = jsonString(json, "mac");
+    device.ip = jsonString(json, "ip");
+    device.targetHardwareId = jsonString(hardware, "targetHardwareIdentifier");
+    device.targetTypeName = jsonString(hardware, "targetTypeName");
+    device.targetPosition = jsonString(hardware, "targetPosition");
+    device.literalName = jsonString(hardware, "literalName");
+    device.manufacturerCode = jsonString(hardware, "manufacturerCode");
+    return !device.targetHardwareId.empty();
+}
+
+static bool sameDevice(const DeviceTable::Device &a, const DeviceTable::Device &b)
+{
+    return a.mac == b.mac &&
+           a.ip == b.ip &&
+           a.targetTypeName == b.targetTypeName &&
+           a.literalName == b.literalName &&
+           a.manufacturerCode == b.manufacturerCode;
+}
+
+DeviceTable &DeviceTable::getInstance()
+{
+    static DeviceTable instance;
+    return instance;
+}
+
+std::string DeviceTable::key(const std::string &targetHardwareId,
+                             const std::string &targetPosition)
+{
+    return targetHardwareId + "|" + targetPosition;
+}
+
+/*
+ * Only new or changed devices make the table dirty, a refreshed last seen
+ * time alone is written along with the next change.
+ */
+DeviceTable::UpdateResult DeviceTable::updateLocked(const Device &device)
+{
+    auto entry = devices.find(key(device.targetHardwareId, device.targetPosition));
+    if (entry == devices.end())
+    {
+        devices[key(device.targetHardwareId, device.targetPosition)] = device;
+        dirty = true;
+        return DEVICE_NEW;
+    }
+    bool changed = !sameDevice(entry->second, device);
+    entry->second = device;
+    dirty = dirty || changed;
+    return changed ? DEVICE_CHANGED : DEVICE_UNCHANGED;
+}
+
+DeviceTable::UpdateResult DeviceTable::update(const std::string &deviceJson, time_t now,
+                                              Device *parsedDevice)
+{
+    cJSON *json = cJSON_Parse(deviceJson.c_str());
+    if (json == NULL)
+    {
+        return DEVICE_INVALID;
+    }
+    Device device;
+    bool valid = parseDevice(json, device);
+    cJSON_Delete(json);
+    if (!valid)
+    {
+        return DEVICE_INVALID;
+    }
+    device.lastSeen = now;
+    if (parsedDevice != NULL)
+    {
+        *parsedDevice = device;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return updateLocked(device);
+}
+
+bool DeviceTable::lookup(const std::string &targetHardwareId,
+                         const std::string &targetPosition, Device &device)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = devices.find(key(targetHardwareId, targetPosition));
+    if (entry == devices.end())
+    {
+        return false;
+    }
+    device = entry->second;
+    return true;
+}
+
+std::vector<DeviceTable::Device> DeviceTable::list()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Device> result;
+    result.reserve(devices.size());
+    for (auto &entry : devices)
+    {
+        result.push_back(entry.second);
+    }
+    return result;
+}
+
+void DeviceTable::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    dirty = dirty || !devices.empty();
+    devices.clear();
+}
+
+bool DeviceTable::isPersistent()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return !persistencePath.empty();
+}
+
+bool DeviceTable::setPersistencePath(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    persistencePath = path;
+    if (path.empty())
+    {
+        return true;
+    }
+
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL)
+    {
+        // Nothing persisted yet, the file is created on the next flush.
+        dirty = !devices.empty();
+        return true;
+    }
+    std::string content;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        content.append(buffer, read);
+    }
+    fclose(fp);
+
+    cJSON *root = cJSON_Parse(content.c_str());
+    if (root == NULL)
+    {
+        return false;
+    }
+    // Devices loaded from the file don't need to be written back, only the
+    // ones the file lacks or has an older version of.
+    std::unordered_set<std::string> storedKeys;
+    bool stale = false;
+    cJSON *jsonDevices = cJSON_GetObjectItemCaseSensitive(root, "devices");
+    for (int i = 0; jsonDevices != NULL && i < cJSON_GetArraySize(jsonDevices); ++i)
+    {
+        cJSON *jsonDevice = cJSON_GetArrayItem(jsonDevices, i);
+        Device device;
+        if (!parseDevice(jsonDevice, device))
+        {
+            continue;
+        }
+        cJSON *lastSeen = cJSON_GetObjectItemCaseSensitive(jsonDevice, "lastSeen");
+        device.lastSeen = lastSeen != NULL ? (time_t)lastSeen->valuedouble : 0;
+
+        std::string deviceKey = key(device.targetHardwareId, device.targetPosition);
+        storedKeys.insert(deviceKey);
+        auto entry = devices.find(deviceKey);
+        if (entry == devices.end() || entry->second.lastSeen < device.lastSeen)
+        {
+            devices[deviceKey] = device;
+        }
+        else if (!sameDevice(entry->second, device))
+        {
+            stale = true;
+        }
+    }
+    cJSON_Delete(root);
+
+    for (auto &entry : devices)
+    {
+        stale = stale || storedKeys.count(entry.first) == 0;
+    }
+    dirty = stale;
+    return true;
+}
+
+bool DeviceTable::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (persistencePath.empty() || !dirty)
+    {
+        return true;
+    }
+
+    // Same format as the devices reported by find, plus the last seen time.
+    cJSON *root = cJSON_CreateObject();
+    cJSON *jsonDevices = cJSON_CreateArray();
+    cJSON_AddItemToObject(root, "devices", jsonDevices);
+    for (auto &entry : devices)
+    {
+        const Device &device = entry.second;
+        cJSON *jsonDevice = cJSON_CreateObject();
+        cJSON_AddStringToObject(jsonDevice, "mac", device.mac.c_str());
+        cJSON_AddStringToObject(jsonDevice, "ip", device.ip.c_str());
+        cJSON *hardware = cJSON_CreateObject();
+        cJSON_AddItemToObject(jsonDevice, "hardware", hardware);
+        cJSON_AddStringToObject(hardware, "targetHardwareIdentifier", device.targetHardwareId.c_str());
+        cJSON_AddStringToObject(hardware, "targetTypeName", device.targetTypeName.c_str());
+        cJSON_AddStringToObject(hardware, "targetPosition", device.targetPosition.c_str());
+        cJSON_AddStringToObject(hardware, "literalName", device.literalName.c_str());
+        cJSON_AddStringToObject(hardware, "manufacturerCode", device.manufacturerCode.c_str());
+        cJSON_AddNumberToObject(jsonDevice, "lastSeen", (double)device.lastSeen);
+        cJSON_AddItemToArray(jsonDevices, jsonDevice);
+    }
+    char *content = cJSON_Print(root);
+    cJSON_Delete(root);
+    if (content == NULL)
+    {
+        return false;
+    }
+
+    // Write to a temporary file first, so a crash never leaves a truncated
+    // table behind.
+    std::string temporaryPath = persistencePath + ".tmp";
+    FILE *fp = fopen(temporaryPath.c_str(), "wb");
+    bool written = fp != NULL && fputs(content, fp) >= 0;
+    if (fp != NULL)
+    {
+        written = fclose(fp) == 0 && written;
+    }
+    cJSON_free(content);
+    if (!written || rename(temporaryPath.c_str(), persistencePath.c_str()) != 0)
+    {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+
+    dirty = false;
+    return true;
+}
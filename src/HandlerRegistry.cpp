@@ -0,0 +1,147 @@
+#include "HandlerRegistry.h"
+
+uint32_t HandlerRegistry::shardOf(struct CommunicationHandler *handler)
+{
+    // The low bits are the same for every allocation, skip them.
+    return (uint32_t)(((uintptr_t)handler >> 4) % HANDLER_REGISTRY_SHARDS);
+}
+
+uint64_t HandlerRegistry::makeId(uint32_t generation, uint32_t index)
+{
+    return ((uint64_t)generation << 32) | index;
+}
+
+HandlerRegistry::Slot *HandlerRegistry::find(Shard &shard,
+                                             struct CommunicationHandler *handler)
+{
+    auto entry = shard.indexes.find(handler);
+    if (entry == shard.indexes.end())
+    {
+        return nullptr;
+    }
+    return &shard.slots[entry->second / HANDLER_REGISTRY_SHARDS];
+}
+
+uint64_t HandlerRegistry::add(struct CommunicationHandler *handler)
+{
+    uint32_t shardIndex = shardOf(handler);
+    Shard &shard = shards[shardIndex];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size_t position;
+    if (!shard.freeSlots.empty())
+    {
+        position = shard.freeSlots.back();
+        shard.freeSlots.pop_back();
+    }
+    else
+    {
+        position = shard.slots.size();
+        shard.slots.emplace_back();
+    }
+
+    Slot &slot = shard.slots[position];
+    slot.handler = handler;
+    slot.pins = 0;
+    slot.retiring = false;
+    uint32_t index = (uint32_t)(position * HANDLER_REGISTRY_SHARDS + shardIndex);
+    shard.indexes[handler] = index;
+    return makeId(slot.generation, index);
+}
+
+struct CommunicationHandler *HandlerRegistry::acquire(uint64_t id)
+{
+    uint32_t index = (uint32_t)id;
+    Shard &shard = shards[index % HANDLER_REGISTRY_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    size_t position = index / HANDLER_REGISTRY_SHARDS;
+    if (position >= shard.slots.size())
+    {
+        return nullptr;
+    }
+    Slot &slot = shard.slots[position];
+    if (slot.handler == nullptr || slot.retiring ||
+        makeId(slot.generation, index) != id)
+    {
+        return nullptr;
+    }
+    slot.pins++;
+    return slot.handler;
+}
+
+bool HandlerRegistry::pin(struct CommunicationHandler *handler)
+{
+    Shard &shard = shards[shardOf(handler)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Slot *slot = find(shard, handler);
+    if (slot == nullptr || slot->retiring)
+    {
+        return false;
+    }
+    slot->pins++;
+    return true;
+}
+
+bool HandlerRegistry::release(struct CommunicationHandler *handler)
+{
+    Shard &shard = shards[shardOf(handler)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Slot *slot = find(shard, handler);
+    if (slot == nullptr || slot->pins == 0)
+    {
+        return false;
+    }
+    if (--slot->pins == 0)
+    {
+        shard.unpinned.notify_all();
+    }
+    return true;
+}
+
+bool HandlerRegistry::retire(struct CommunicationHandler *handler)
+{
+    Shard &shard = shards[shardOf(handler)];
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    Slot *slot = find(shard, handler);
+    if (slot == nullptr || slot->retiring)
+    {
+        return false;
+    }
+    slot->retiring = true;
+    shard.unpinned.wait(lock, [slot]
+                        { return slot->pins == 0; });
+    return true;
+}
+
+void HandlerRegistry::remove(struct CommunicationHandler *handler)
+{
+    Shard &shard = shards[shardOf(handler)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto entry = shard.indexes.find(handler);
+    if (entry == shard.indexes.end())
+    {
+        return;
+    }
+    size_t position = entry->second / HANDLER_REGISTRY_SHARDS;
+    Slot &slot = shard.slots[position];
+    slot.handler = nullptr;
+    // Generation 0 is skipped, so no id is ever 0.
+    if (++slot.generation == 0)
+    {
+        slot.generation = 1;
+    }
+    shard.freeSlots.push_back(position);
+    shard.indexes.erase(entry);
+}
+
+void HandlerRegistry::forEach(
+    const std::function<void(struct CommunicationHandler *)> &function)
+{
+    for (auto &shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto &entry : shard.indexes)
+        {
+            function(entry.first);
+        }
+    }
+}
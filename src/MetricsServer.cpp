@@ -0,0 +1,176 @@
+#include "MetricsServer.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+// Scrapers send short requests, anything longer is not for us.
+#define METRICS_REQUEST_MAX_SIZE 8192
+#define METRICS_CONNECTION_TIMEOUT_S 2
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+bool MetricsServer::start(unsigned short port, const std::string &contentType,
+                          RenderFunction render)
+{
+    stop();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    socklen_t addressSize = sizeof(address);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(fd, SOMAXCONN) != 0 ||
+        getsockname(fd, (struct sockaddr *)&address, &addressSize) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    stopFd = eventfd(0, EFD_CLOEXEC);
+    if (stopFd < 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    listenFd = fd;
+    this->port = ntohs(address.sin_port);
+    this->contentType = contentType;
+    this->render = render;
+    thread = std::thread(&MetricsServer::run, this);
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!thread.joinable())
+    {
+        return;
+    }
+
+    uint64_t signal = 1;
+    if (write(stopFd, &signal, sizeof(signal)) != sizeof(signal))
+    {
+        // Can't happen with a fresh eventfd, the thread would still be
+        // waiting for connections.
+    }
+    thread.join();
+
+    close(listenFd);
+    close(stopFd);
+    listenFd = -1;
+    stopFd = -1;
+    port = 0;
+}
+
+unsigned short MetricsServer::getPort()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return port;
+}
+
+void MetricsServer::run()
+{
+    while (true)
+    {
+        struct pollfd pollFds[2];
+        pollFds[0].fd = listenFd;
+        pollFds[0].events = POLLIN;
+        pollFds[0].revents = 0;
+        pollFds[1].fd = stopFd;
+        pollFds[1].events = POLLIN;
+        pollFds[1].revents = 0;
+        if (poll(pollFds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        if (pollFds[1].revents != 0)
+        {
+            return;
+        }
+        if (pollFds[0].revents & POLLIN)
+        {
+            int connectionFd = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+            if (connectionFd >= 0)
+            {
+                serve(connectionFd);
+                close(connectionFd);
+            }
+        }
+    }
+}
+
+void MetricsServer::serve(int connectionFd)
+{
+    // A stalled client must not hold the server forever.
+    struct timeval timeout = {};
+    timeout.tv_sec = METRICS_CONNECTION_TIMEOUT_S;
+    setsockopt(connectionFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(connectionFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos &&
+           request.size() < METRICS_REQUEST_MAX_SIZE)
+    {
+        ssize_t received = recv(connectionFd, buffer, sizeof(buffer), 0);
+        if (received <= 0)
+        {
+            return;
+        }
+        request.append(buffer, received);
+    }
+
+    std::string response;
+    if (request.compare(0, 4, "GET ") == 0)
+    {
+        std::string body = render();
+        response = "HTTP/1.0 200 OK\r\n";
+        response += "Content-Type: " + contentType + "\r\n";
+        response += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        response += "Connection: close\r\n\r\n";
+        response += body;
+    }
+    else
+    {
+        response = "HTTP/1.0 405 Method Not Allowed\r\n"
+                   "Content-Length: 0\r\n"
+                   "Connection: close\r\n\r\n";
+    }
+
+    size_t sent = 0;
+    while (sent < response.size())
+    {
+        ssize_t written = send(connectionFd, response.data() + sent,
+                               response.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0)
+        {
+            return;
+        }
+        sent += written;
+    }
+}
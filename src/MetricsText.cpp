@@ -0,0 +1,69 @@
+#include "MetricsText.h"
+
+#include <stdio.h>
+
+#define METRICS_PREFIX "arinc615a_"
+
+void MetricsText::family(const char *name, const char *type, const char *help)
+{
+    text += "# TYPE " METRICS_PREFIX;
+    text += name;
+    text += " ";
+    text += type;
+    text += "\n# HELP " METRICS_PREFIX;
+    text += name;
+    text += " ";
+    text += help;
+    text += "\n";
+}
+
+void MetricsText::counter(const char *name, const char *help, uint64_t value)
+{
+    family(name, "counter", help);
+    text += METRICS_PREFIX;
+    text += name;
+    text += "_total " + std::to_string(value) + "\n";
+}
+
+void MetricsText::gauge(const char *name, const char *help, uint64_t value)
+{
+    family(name, "gauge", help);
+    text += METRICS_PREFIX;
+    text += name;
+    text += " " + std::to_string(value) + "\n";
+}
+
+void MetricsText::histogram(const char *name, const char *help,
+                            const LatencyHistogram &histogram)
+{
+    char line[128];
+    family(name, "histogram", help);
+
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i)
+    {
+        cumulative += histogram.buckets[i];
+        if (i < LATENCY_HISTOGRAM_BUCKETS - 1)
+        {
+            snprintf(line, sizeof(line), METRICS_PREFIX "%s_bucket{le=\"%g\"} %llu\n",
+                     name, (double)((uint64_t)1 << i) / 1000,
+                     (unsigned long long)cumulative);
+        }
+        else
+        {
+            snprintf(line, sizeof(line), METRICS_PREFIX "%s_bucket{le=\"+Inf\"} %llu\n",
+                     name, (unsigned long long)cumulative);
+        }
+        text += line;
+    }
+    snprintf(line, sizeof(line), METRICS_PREFIX "%s_sum %.6f\n" METRICS_PREFIX "%s_count %llu\n",
+             name, (double)histogram.totalUs / 1000000, name,
+             (unsigned long long)histogram.count);
+    text += line;
+}
+
+std::string MetricsText::finish()
+{
+    text += "# EOF\n";
+    return text;
+}
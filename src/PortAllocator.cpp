@@ -0,0 +1,65 @@
+#include "PortAllocator.h"
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+PortAllocator::PortAllocator(unsigned short first, unsigned short last)
+{
+    firstPort = first;
+    lastPort = last;
+    nextPort = first;
+}
+
+bool PortAllocator::setRange(unsigned short first, unsigned short last)
+{
+    if (first == 0 || first > last)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    firstPort = first;
+    lastPort = last;
+    nextPort = first;
+    return true;
+}
+
+bool PortAllocator::allocate(unsigned short *port)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    unsigned int rangeSize = (unsigned int)lastPort - firstPort + 1;
+    for (unsigned int i = 0; i < rangeSize; ++i)
+    {
+        unsigned short candidate = nextPort;
+        nextPort = candidate == lastPort ? firstPort : candidate + 1;
+        if (allocated.count(candidate) == 0 && isBindable(candidate))
+        {
+            allocated.insert(candidate);
+            *port = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PortAllocator::release(unsigned short port)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    allocated.erase(port);
+}
+
+bool PortAllocator::isBindable(unsigned short port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    bool bindable = bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0;
+    close(fd);
+    return bindable;
+}
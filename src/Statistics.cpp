@@ -0,0 +1,48 @@
+#include "Statistics.h"
+
+#include <algorithm>
+
+void Statistics::recordLatency(LatencyHistogram *histogram,
+                               std::chrono::steady_clock::duration duration)
+{
+    uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    uint64_t ms = us / 1000;
+    size_t bucket = 0;
+    while (bucket < LATENCY_HISTOGRAM_BUCKETS - 1 && ms >= ((uint64_t)1 << bucket))
+    {
+        bucket++;
+    }
+    histogram->count++;
+    histogram->totalUs += us;
+    histogram->maxUs = std::max(histogram->maxUs, us);
+    histogram->buckets[bucket]++;
+}
+
+void Statistics::mergeLatency(LatencyHistogram *into, const LatencyHistogram &from)
+{
+    into->count += from.count;
+    into->totalUs += from.totalUs;
+    into->maxUs = std::max(into->maxUs, from.maxUs);
+    for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i)
+    {
+        into->buckets[i] += from.buckets[i];
+    }
+}
+
+void Statistics::merge(HandlerStats *into, const HandlerStats &from)
+{
+    into->uploads += from.uploads;
+    into->uploadFailures += from.uploadFailures;
+    into->authentications += from.authentications;
+    into->authenticationFailures += from.authenticationFailures;
+    into->retries += from.retries;
+    into->bytesSent += from.bytesSent;
+    into->statusMessages += from.statusMessages;
+    mergeLatency(&into->uploadLatency, from.uploadLatency);
+    mergeLatency(&into->authenticationLatency, from.authenticationLatency);
+    mergeLatency(&into->encryptionLatency, from.encryptionLatency);
+    mergeLatency(&into->initializationLatency, from.initializationLatency);
+    mergeLatency(&into->transferLatency, from.transferLatency);
+    mergeLatency(&into->statusInterval, from.statusInterval);
+    mergeLatency(&into->callbackLatency, from.callbackLatency);
+}
@@ -0,0 +1,132 @@
+#include "Trace.h"
+
+#ifdef COMMUNICATION_MANAGER_TRACE
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+std::mutex Trace::buffersMutex;
+std::vector<std::unique_ptr<Trace::Buffer>> Trace::buffers;
+std::vector<Trace::Buffer *> Trace::freeBuffers;
+
+Trace::ThreadBuffer::ThreadBuffer()
+{
+    threadId = (uint32_t)syscall(SYS_gettid);
+
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    if (!freeBuffers.empty())
+    {
+        buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+    }
+    else
+    {
+        buffers.emplace_back(new Buffer());
+        buffer = buffers.back().get();
+    }
+}
+
+Trace::ThreadBuffer::~ThreadBuffer()
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    freeBuffers.push_back(buffer);
+}
+
+uint64_t Trace::toUs(std::chrono::steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch())
+        .count();
+}
+
+/*
+ * Only the owner thread writes to its buffer. Each event is guarded by a
+ * sequence number, odd while the event is written, so dump can tell and
+ * skip events overwritten while it reads them.
+ */
+void Trace::record(const char *name, uint64_t startUs, uint64_t durationUs,
+                   bool instant)
+{
+    static thread_local ThreadBuffer threadBuffer;
+    Buffer *buffer = threadBuffer.buffer;
+
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    Event &event = buffer->events[head % TRACE_BUFFER_EVENTS];
+    uint64_t sequence = event.sequence.load(std::memory_order_relaxed);
+    event.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name.store(name, std::memory_order_relaxed);
+    event.startUs.store(startUs, std::memory_order_relaxed);
+    event.durationUs.store(durationUs, std::memory_order_relaxed);
+    event.threadId.store(threadBuffer.threadId, std::memory_order_relaxed);
+    event.instant.store(instant, std::memory_order_relaxed);
+    event.sequence.store(sequence + 2, std::memory_order_release);
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::span(const char *name,
+                 std::chrono::steady_clock::time_point start,
+                 std::chrono::steady_clock::time_point end)
+{
+    uint64_t startUs = toUs(start);
+    uint64_t endUs = toUs(end);
+    record(name, startUs, endUs > startUs ? endUs - startUs : 0, false);
+}
+
+void Trace::instant(const char *name)
+{
+    record(name, toUs(std::chrono::steady_clock::now()), 0, true);
+}
+
+bool Trace::dump(const std::string &path)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    int pid = (int)getpid();
+    bool first = true;
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    for (auto &buffer : buffers)
+    {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t tail = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+        for (uint64_t i = tail; i < head; ++i)
+        {
+            Event &event = buffer->events[i % TRACE_BUFFER_EVENTS];
+            uint64_t sequence = event.sequence.load(std::memory_order_acquire);
+            const char *name = event.name.load(std::memory_order_relaxed);
+            uint64_t startUs = event.startUs.load(std::memory_order_relaxed);
+            uint64_t durationUs = event.durationUs.load(std::memory_order_relaxed);
+            uint32_t threadId = event.threadId.load(std::memory_order_relaxed);
+            bool instant = event.instant.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence == 0 || (sequence & 1) != 0 ||
+                event.sequence.load(std::memory_order_relaxed) != sequence)
+            {
+                continue;
+            }
+
+            fprintf(fp, "%s\n{\"name\":\"%s\",\"cat\":\"communication\",\"pid\":%d,\"tid\":%u,\"ts\":%llu,",
+                    first ? "" : ",", name, pid, threadId, (unsigned long long)startUs);
+            if (instant)
+            {
+                fprintf(fp, "\"ph\":\"i\",\"s\":\"t\"}");
+            }
+            else
+            {
+                fprintf(fp, "\"ph\":\"X\",\"dur\":%llu}", (unsigned long long)durationUs);
+            }
+            first = false;
+        }
+    }
+
+    fprintf(fp, "\n]}\n");
+    return fclose(fp) == 0;
+}
+
+#endif // COMMUNICATION_MANAGER_TRACE
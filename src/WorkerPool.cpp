@@ -0,0 +1,105 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool()
+{
+    stopping = false;
+    unsigned int cpus = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < std::max(1u, cpus - 1); ++i)
+    {
+        threads.push_back(std::thread(&WorkerPool::workerLoop, this));
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+WorkerPool &WorkerPool::getInstance()
+{
+    static WorkerPool instance;
+    return instance;
+}
+
+unsigned int WorkerPool::size() const
+{
+    return (unsigned int)threads.size();
+}
+
+void WorkerPool::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        condition.wait(lock, [this]()
+                       { return stopping || !queue.empty(); });
+        if (stopping)
+        {
+            return;
+        }
+        std::shared_ptr<Job> job = queue.front();
+        queue.pop_front();
+        lock.unlock();
+
+        {
+            std::unique_lock<std::mutex> jobLock(job->mutex);
+            if (!job->closed)
+            {
+                job->running++;
+                jobLock.unlock();
+                (*job->function)();
+                jobLock.lock();
+                if (--job->running == 0)
+                {
+                    job->finished.notify_all();
+                }
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+void WorkerPool::run(const std::function<void()> &function, unsigned int helpers)
+{
+    helpers = std::min(helpers, size());
+    if (helpers == 0)
+    {
+        function();
+        return;
+    }
+
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->function = &function;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (unsigned int i = 0; i < helpers; ++i)
+        {
+            queue.push_back(job);
+        }
+    }
+    condition.notify_all();
+
+    function();
+
+    // Helpers that didn't start yet must not start anymore, the function
+    // and what it refers to are about to go away.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.erase(std::remove(queue.begin(), queue.end(), job), queue.end());
+    }
+    std::unique_lock<std::mutex> jobLock(job->mutex);
+    job->closed = true;
+    job->finished.wait(jobLock, [&job]()
+                       { return job->running == 0; });
+}
@@ -1,12 +1,41 @@
 #include "icommunicationmanager.h"
 #include "AuthenticationManager.h"
+#include "AsyncUploadPool.h"
 #include "CommunicationManager.h"
+#include "LoadUploadStatusFileARINC615A.h"
+#include "DeviceTable.h"
+#include "HandlerRegistry.h"
+#include "MetricsServer.h"
+#include "MetricsText.h"
+#include "PortAllocator.h"
+#include "Statistics.h"
+#include "Trace.h"
 
+#include <cjson/cJSON.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <unistd.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <stdint.h>
+#include <random>
 #include <time.h>
 
 struct CommunicationHandler
 {
-    unsigned long id;
+    uint64_t id;
     CommunicationManager *communicationManager;
     AuthenticationManager *authenticationManager;
 
@@ -16,17 +45,210 @@ struct CommunicationHandler
     void *_findFinishedContext;
     find_new_device _findNewDeviceCallback;
     void *_findNewDeviceContext;
+    bool _findReportChangesOnly;
+    bool _findParseDevices;
+
+    // Devices waiting to be delivered to the batch callback
+    find_new_devices_batch_callback _findNewDevicesBatchCallback;
+    void *_findNewDevicesBatchContext;
+    size_t _findBatchSize;
+    unsigned int _findBatchWindowMs;
+    std::mutex _findBatchMutex;
+    std::vector<DiscoveredDevice> _findBatch;
+    std::chrono::steady_clock::time_point _findBatchStart;
 
+    // State of the running find, to bound it with a deadline
+    std::mutex _findMutex;
+    std::condition_variable _findCondition;
+    std::thread _findWorker;
+    bool _findWorkerRunning;
+    bool _findDone;
+    bool _findFinishedReported;
+    CommunicationOperationResult _findResult;
+    std::atomic<bool> _findExpired;
+
+    // Handler passed to the upload callbacks: the handler itself, or the
+    // template handler for the handlers upload_batch runs its jobs on.
+    CommunicationHandlerPtr _callbackHandler;
     upload_initialization_response_callback _uploadInitializationResponseCallback;
     void *_uploadInitializationResponseContext;
     upload_information_status_callback _uploadInformationStatusCallback;
     void *_uploadInformationStatusContext;
+    upload_initialization_response_typed_callback _uploadInitializationResponseTypedCallback;
+    void *_uploadInitializationResponseTypedContext;
+    upload_information_status_typed_callback _uploadInformationStatusTypedCallback;
+    void *_uploadInformationStatusTypedContext;
     file_not_available_callback _fileNotAvailableCallback;
     void *_fileNotAvailableContext;
+
+    // Record the loads confirmed by the TargetHardware, for resume_upload
+    bool _uploadCheckpointEnabled;
+
+    UploadRetryPolicy _uploadRetryPolicy;
+    std::atomic<unsigned short> _lastUploadStatusCode;
+    std::mutex _uploadRetryMutex;
+    std::condition_variable _uploadRetryCondition;
+    std::atomic<bool> _uploadRetryCancelled;
+
+    std::mutex _asyncUploadMutex;
+    struct AsyncUpload *_asyncUpload;
+
+    // Port allocated for the running upload when the DataLoader server port
+    // was set to TFTP_DATALOADER_SERVER_PORT_AUTO.
+    bool _tftpDataLoaderServerPortAuto;
+    std::atomic<unsigned short> _tftpDataLoaderServerPortAllocated;
+
+    // Statistics, updated from the upload, status and find threads
+    std::mutex _statsMutex;
+    HandlerStats _stats;
+    bool _statsInitializationPending;
+    std::chrono::steady_clock::time_point _statsTransferStart;
+    std::chrono::steady_clock::time_point _statsLastStatus;
+
+    // Settings kept so they can be replicated to other handlers
+    unsigned short _tftpDataLoaderServerPort;
+    unsigned short _tftpTargetHardwareServerPort;
+    Certificate _certificate;
+    bool _certificateSet;
+    unsigned int _authenticationSessionTtl;
+    unsigned int _authenticationEncryptionWorkers;
+    bool _authenticationEncryptionWorkersSet;
+    CiphertextFormat _authenticationCiphertextFormat;
+};
+
+struct UploadRetryState
+{
+    unsigned int authenticationFailures;
+    unsigned int transferFailures;
+};
+
+struct AsyncUpload : public AsyncUploadPool::Operation
+{
+    CommunicationHandlerPtr handler;
+    std::thread worker;
+
+    // Retries of uploads run on the shared workers, which are queued again
+    // instead of waiting in the worker.
+    bool started;
+    bool resume;
+    std::chrono::steady_clock::time_point startedAt;
+    struct UploadRetryState retryState;
+    CommunicationOperationResult attemptResult;
+    std::mutex mutex;
+    std::condition_variable finishedCondition;
+    bool finished;
+    CommunicationOperationResult result;
+    int eventFd;
+
+    bool step(std::chrono::steady_clock::time_point *retryAt) override;
+    bool isCancelled() override;
+    void abandon() override;
 };
 
+static void joinAsyncUploadWorker(struct AsyncUpload *operation);
+static void cancelAsyncUpload(struct AsyncUpload *operation);
+static void detachAsyncUpload(struct AsyncUpload *operation);
+static void wakeAsyncUploadWorkers();
+
 // TODO: we may limit the number of handlers here, but for now we don't.
-std::unordered_map<unsigned long, struct CommunicationHandler *> handlers;
+static HandlerRegistry handlers;
+
+// Ports handed out when the DataLoader server port is
+// TFTP_DATALOADER_SERVER_PORT_AUTO.
+static PortAllocator dataLoaderPorts(TFTP_DATALOADER_PORT_RANGE_FIRST,
+                                     TFTP_DATALOADER_PORT_RANGE_LAST);
+
+/*
+ * Process-wide statistics of destroyed handlers and of reset statistics, so
+ * the process totals never go back. Statistics move here under this lock,
+ * which metrics rendering holds as well, so they're never seen twice or
+ * missed.
+ */
+static std::mutex retiredStatsMutex;
+static HandlerStats retiredStats;
+
+static std::atomic<uint64_t> activeUploads(0);
+static std::atomic<uint64_t> queuedBatchJobs(0);
+
+static void recordUpload(CommunicationHandlerPtr handler,
+                         std::chrono::steady_clock::time_point start,
+                         CommunicationOperationResult result)
+{
+    activeUploads--;
+    std::lock_guard<std::mutex> lock(handler->_statsMutex);
+    handler->_stats.uploads++;
+    handler->_stats.uploadFailures += result != COMMUNICATION_OPERATION_OK ? 1 : 0;
+    Statistics::recordLatency(&handler->_stats.uploadLatency, std::chrono::steady_clock::now() - start);
+}
+
+/*
+ * Records the time spent in an application callback, from its construction
+ * to the end of the enclosing scope.
+ */
+class CallbackTimer
+{
+public:
+    explicit CallbackTimer(CommunicationHandlerPtr handler)
+        : handler(handler), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~CallbackTimer()
+    {
+        std::lock_guard<std::mutex> lock(handler->_statsMutex);
+        Statistics::recordLatency(&handler->_stats.callbackLatency,
+                                  std::chrono::steady_clock::now() - start);
+    }
+
+private:
+    CommunicationHandlerPtr handler;
+    std::chrono::steady_clock::time_point start;
+};
+
+static void copyString(char *destination, const std::string &source, size_t size)
+{
+    strncpy(destination, source.c_str(), size - 1);
+    destination[size - 1] = '\0';
+}
+
+static void copyDevice(DiscoveredDevice *destination, const DeviceTable::Device &source)
+{
+    copyString(destination->mac, source.mac, sizeof(destination->mac));
+    copyString(destination->ip, source.ip, sizeof(destination->ip));
+    copyString(destination->targetHardwareId, source.targetHardwareId,
+               sizeof(destination->targetHardwareId));
+    copyString(destination->targetTypeName, source.targetTypeName,
+               sizeof(destination->targetTypeName));
+    copyString(destination->targetPosition, source.targetPosition,
+               sizeof(destination->targetPosition));
+    copyString(destination->literalName, source.literalName,
+               sizeof(destination->literalName));
+    copyString(destination->manufacturerCode, source.manufacturerCode,
+               sizeof(destination->manufacturerCode));
+    destination->lastSeen = (int64_t)source.lastSeen;
+}
+
+static void flushFindBatch(CommunicationHandlerPtr handler)
+{
+    std::vector<DiscoveredDevice> batch;
+    find_new_devices_batch_callback callback;
+    void *context;
+    {
+        // The callback may be registered again while a find is running.
+        std::lock_guard<std::mutex> lock(handler->_findBatchMutex);
+        callback = handler->_findNewDevicesBatchCallback;
+        context = handler->_findNewDevicesBatchContext;
+        if (handler->_findBatch.empty() || callback == nullptr)
+        {
+            return;
+        }
+        // Hand over the buffer, keeping its capacity for the next batch.
+        batch.reserve(handler->_findBatchSize);
+        batch.swap(handler->_findBatch);
+    }
+    CallbackTimer timer(handler);
+    callback(handler, batch.data(), batch.size(), context);
+}
 
 static FindOperationResult findStartedCbk(
     void *context)
@@ -34,6 +256,7 @@ static FindOperationResult findStartedCbk(
     auto handler = (struct CommunicationHandler *)context;
     if (handler->_findStartedCallback != nullptr)
     {
+        CallbackTimer timer(handler);
         handler->_findStartedCallback(handler,
                                       handler->_findStartedContext);
         return FindOperationResult::FIND_OPERATION_OK;
@@ -45,13 +268,29 @@ static FindOperationResult findFinishedCbk(
     void *context)
 {
     auto handler = (struct CommunicationHandler *)context;
-    if (handler->_findFinishedCallback != nullptr)
+
+    // Persist what this find discovered in one go.
+    DeviceTable::getInstance().flush();
+    flushFindBatch(handler);
+
+    // If the find outlived its deadline, the application was already told
+    // it finished.
+    bool report;
+    {
+        std::lock_guard<std::mutex> lock(handler->_findMutex);
+        handler->_findDone = true;
+        report = !handler->_findFinishedReported;
+        handler->_findFinishedReported = true;
+    }
+    handler->_findCondition.notify_all();
+
+    if (report && handler->_findFinishedCallback != nullptr)
     {
+        CallbackTimer timer(handler);
         handler->_findFinishedCallback(handler,
                                        handler->_findFinishedContext);
-        return FindOperationResult::FIND_OPERATION_OK;
     }
-    return FindOperationResult::FIND_OPERATION_ERROR;
+    return FindOperationResult::FIND_OPERATION_OK;
 }
 
 static FindOperationResult findNewDeviceCbk(
@@ -59,14 +298,134 @@ static FindOperationResult findNewDeviceCbk(
     void *context)
 {
     auto handler = (struct CommunicationHandler *)context;
+
+    // The device JSON is only parsed when something needs the device.
+    DeviceTable::Device parsedDevice;
+    DeviceTable::UpdateResult update = DeviceTable::DEVICE_INVALID;
+    if (handler->_findParseDevices)
+    {
+        update = DeviceTable::getInstance().update(device, time(NULL), &parsedDevice);
+    }
+    if (handler->_findExpired ||
+        (handler->_findReportChangesOnly && update == DeviceTable::DEVICE_UNCHANGED))
+    {
+        return FindOperationResult::FIND_OPERATION_OK;
+    }
+
+    if (update != DeviceTable::DEVICE_INVALID)
+    {
+        bool flush = false;
+        std::unique_lock<std::mutex> lock(handler->_findBatchMutex);
+        if (handler->_findNewDevicesBatchCallback != nullptr)
+        {
+            auto now = std::chrono::steady_clock::now();
+            if (handler->_findBatch.empty())
+            {
+                handler->_findBatchStart = now;
+            }
+            handler->_findBatch.emplace_back();
+            copyDevice(&handler->_findBatch.back(), parsedDevice);
+            flush = handler->_findBatch.size() >= handler->_findBatchSize ||
+                    (handler->_findBatchWindowMs > 0 &&
+                     now - handler->_findBatchStart >=
+                         std::chrono::milliseconds(handler->_findBatchWindowMs));
+        }
+        lock.unlock();
+        if (flush)
+        {
+            flushFindBatch(handler);
+        }
+    }
+
     if (handler->_findNewDeviceCallback != nullptr)
     {
+        CallbackTimer timer(handler);
         handler->_findNewDeviceCallback(handler,
                                         device.c_str(),
                                         handler->_findNewDeviceContext);
-        return FindOperationResult::FIND_OPERATION_OK;
     }
-    return FindOperationResult::FIND_OPERATION_ERROR;
+    return FindOperationResult::FIND_OPERATION_OK;
+}
+
+// ARINC-615A status fields may come either as numbers or as strings.
+static unsigned short jsonNumber(cJSON *object, const char *name)
+{
+    cJSON *item = cJSON_GetObjectItemCaseSensitive(object, name);
+    if (item == NULL)
+    {
+        return 0;
+    }
+    if (item->valuestring != NULL)
+    {
+        return (unsigned short)atoi(item->valuestring);
+    }
+    return (unsigned short)item->valueint;
+}
+
+static void jsonString(cJSON *object, const char *name, char *buffer, size_t bufferSize)
+{
+    cJSON *item = cJSON_GetObjectItemCaseSensitive(object, name);
+    buffer[0] = '\0';
+    if (item != NULL && item->valuestring != NULL)
+    {
+        strncpy(buffer, item->valuestring, bufferSize - 1);
+        buffer[bufferSize - 1] = '\0';
+    }
+}
+
+static bool parseUploadInitializationResponse(
+    const std::string &json, UploadInitializationResponse *response)
+{
+    cJSON *root = cJSON_Parse(json.c_str());
+    if (root == NULL)
+    {
+        return false;
+    }
+    response->operationAcceptanceStatusCode = jsonNumber(root, "operationAcceptanceStatusCode");
+    jsonString(root, "statusDescription", response->statusDescription,
+               sizeof(response->statusDescription));
+    cJSON_Delete(root);
+    return true;
+}
+
+static bool parseUploadInformationStatus(
+    const std::string &json, UploadInformationStatus *status,
+    std::vector<UploadHeaderFileStatus> &headerFiles)
+{
+    cJSON *root = cJSON_Parse(json.c_str());
+    if (root == NULL)
+    {
+        return false;
+    }
+    status->uploadOperationStatusCode = jsonNumber(root, "uploadOperationStatusCode");
+    jsonString(root, "uploadStatusDescription", status->uploadStatusDescription,
+               sizeof(status->uploadStatusDescription));
+    status->counter = jsonNumber(root, "counter");
+    status->exceptionTimer = jsonNumber(root, "exceptionTimer");
+    status->estimatedTime = jsonNumber(root, "estimatedTime");
+    status->loadListRatio = jsonNumber(root, "loadListRatio");
+
+    headerFiles.clear();
+    cJSON *jsonHeaderFiles = cJSON_GetObjectItemCaseSensitive(root, "headerFiles");
+    for (int i = 0; jsonHeaderFiles != NULL && i < cJSON_GetArraySize(jsonHeaderFiles); ++i)
+    {
+        cJSON *jsonHeaderFile = cJSON_GetArrayItem(jsonHeaderFiles, i);
+        UploadHeaderFileStatus headerFile;
+        jsonString(jsonHeaderFile, "headerFileName", headerFile.headerFileName,
+                   sizeof(headerFile.headerFileName));
+        jsonString(jsonHeaderFile, "loadPartNumberName", headerFile.loadPartNumberName,
+                   sizeof(headerFile.loadPartNumberName));
+        headerFile.loadRatio = jsonNumber(jsonHeaderFile, "loadRatio");
+        headerFile.loadStatus = jsonNumber(jsonHeaderFile, "loadStatus");
+        jsonString(jsonHeaderFile, "loadStatusDescription", headerFile.loadStatusDescription,
+                   sizeof(headerFile.loadStatusDescription));
+        headerFiles.push_back(headerFile);
+    }
+    status->numberOfHeaderFiles = headerFiles.size();
+    status->headerFiles = headerFiles.data();
+
+    cJSON_Delete(root);
+    return true;
 }
 
 static UploadOperationResult uploadInitializationResponseCbk(
@@ -74,14 +433,48 @@ static UploadOperationResult uploadInitializationResponseCbk(
     void *context)
 {
     auto handler = (struct CommunicationHandler *)context;
-    if (handler != nullptr && handler->_uploadInitializationResponseCallback != nullptr)
+    if (handler == nullptr)
+    {
+        return UploadOperationResult::UPLOAD_OPERATION_ERROR;
+    }
+
     {
-        handler->_uploadInitializationResponseCallback(handler,
+        // Only the first response of a transfer tells how long it took to
+        // be accepted.
+        std::lock_guard<std::mutex> lock(handler->_statsMutex);
+        if (handler->_statsInitializationPending)
+        {
+            auto now = std::chrono::steady_clock::now();
+            TRACE_SPAN("upload initialization", handler->_statsTransferStart, now);
+            Statistics::recordLatency(&handler->_stats.initializationLatency,
+                                      now - handler->_statsTransferStart);
+            handler->_statsInitializationPending = false;
+        }
+    }
+
+    bool called = false;
+    if (handler->_uploadInitializationResponseCallback != nullptr)
+    {
+        CallbackTimer timer(handler);
+        handler->_uploadInitializationResponseCallback(handler->_callbackHandler,
                                                        uploadInitializationResponseJson.c_str(),
                                                        handler->_uploadInitializationResponseContext);
-        return UploadOperationResult::UPLOAD_OPERATION_OK;
+        called = true;
     }
-    return UploadOperationResult::UPLOAD_OPERATION_ERROR;
+
+    UploadInitializationResponse response;
+    if (handler->_uploadInitializationResponseTypedCallback != nullptr &&
+        parseUploadInitializationResponse(uploadInitializationResponseJson, &response))
+    {
+        CallbackTimer timer(handler);
+        handler->_uploadInitializationResponseTypedCallback(handler->_callbackHandler,
+                                                            &response,
+                                                            handler->_uploadInitializationResponseTypedContext);
+        called = true;
+    }
+
+    return called ? UploadOperationResult::UPLOAD_OPERATION_OK
+                  : UploadOperationResult::UPLOAD_OPERATION_ERROR;
 }
 
 static UploadOperationResult uploadInformationStatusCbk(
@@ -89,14 +482,65 @@ static UploadOperationResult uploadInformationStatusCbk(
     void *context)
 {
     auto handler = (struct CommunicationHandler *)context;
-    if (handler != nullptr && handler->_uploadInformationStatusCallback != nullptr)
+    if (handler == nullptr)
+    {
+        return UploadOperationResult::UPLOAD_OPERATION_ERROR;
+    }
+
+    TRACE_SCOPE("upload status");
     {
-        handler->_uploadInformationStatusCallback(handler,
+        std::lock_guard<std::mutex> lock(handler->_statsMutex);
+        auto now = std::chrono::steady_clock::now();
+        handler->_stats.statusMessages++;
+        if (handler->_statsLastStatus != std::chrono::steady_clock::time_point())
+        {
+            Statistics::recordLatency(&handler->_stats.statusInterval, now - handler->_statsLastStatus);
+        }
+        handler->_statsLastStatus = now;
+    }
+
+    bool called = false;
+    if (handler->_uploadInformationStatusCallback != nullptr)
+    {
+        CallbackTimer timer(handler);
+        handler->_uploadInformationStatusCallback(handler->_callbackHandler,
                                                   uploadInformationStatusJson.c_str(),
                                                   handler->_uploadInformationStatusContext);
-        return UploadOperationResult::UPLOAD_OPERATION_OK;
+        called = true;
     }
-    return UploadOperationResult::UPLOAD_OPERATION_ERROR;
+
+    UploadInformationStatus status;
+    std::vector<UploadHeaderFileStatus> headerFiles;
+    if ((handler->_uploadInformationStatusTypedCallback != nullptr ||
+         handler->_uploadCheckpointEnabled ||
+         handler->_uploadRetryPolicy.retryableStatusCodesSize > 0) &&
+        parseUploadInformationStatus(uploadInformationStatusJson, &status, headerFiles))
+    {
+        handler->_lastUploadStatusCode = status.uploadOperationStatusCode;
+        if (handler->_uploadCheckpointEnabled)
+        {
+            for (auto &headerFile : headerFiles)
+            {
+                if (headerFile.loadStatus == STATUS_UPLOAD_COMPLETED)
+                {
+                    handler->communicationManager->setLoadCompleted(headerFile.headerFileName,
+                                                                    headerFile.loadPartNumberName);
+                }
+            }
+            called = true;
+        }
+        if (handler->_uploadInformationStatusTypedCallback != nullptr)
+        {
+            CallbackTimer timer(handler);
+            handler->_uploadInformationStatusTypedCallback(handler->_callbackHandler,
+                                                           &status,
+                                                           handler->_uploadInformationStatusTypedContext);
+            called = true;
+        }
+    }
+
+    return called ? UploadOperationResult::UPLOAD_OPERATION_OK
+                  : UploadOperationResult::UPLOAD_OPERATION_ERROR;
 }
 
 static UploadOperationResult fileNotAvailableCbk(
@@ -108,10 +552,13 @@ static UploadOperationResult fileNotAvailableCbk(
     if (handler != nullptr && handler->_fileNotAvailableCallback != nullptr)
     {
         unsigned short waitTime = 0;
-        handler->_fileNotAvailableCallback(handler,
-                                           fileName.c_str(),
-                                           &waitTime,
-                                           handler->_fileNotAvailableContext);
+        {
+            CallbackTimer timer(handler);
+            handler->_fileNotAvailableCallback(handler->_callbackHandler,
+                                               fileName.c_str(),
+                                               &waitTime,
+                                               handler->_fileNotAvailableContext);
+        }
         *waitTimeS = waitTime;
         return UploadOperationResult::UPLOAD_OPERATION_OK;
     }
@@ -127,16 +574,47 @@ static AuthenticationOperationResult certificateNotAvailableCbk(
     if (handler != nullptr && handler->_fileNotAvailableCallback != nullptr)
     {
         unsigned short waitTime = 0;
-        handler->_fileNotAvailableCallback(handler,
-                                           fileName.c_str(),
-                                           &waitTime,
-                                           handler->_fileNotAvailableContext);
+        {
+            CallbackTimer timer(handler);
+            handler->_fileNotAvailableCallback(handler->_callbackHandler,
+                                               fileName.c_str(),
+                                               &waitTime,
+                                               handler->_fileNotAvailableContext);
+        }
         *waitTimeS = waitTime;
         return AuthenticationOperationResult::AUTHENTICATION_OPERATION_OK;
     }
     return AuthenticationOperationResult::AUTHENTICATION_OPERATION_ERROR;
 }
 
+/*
+ * Status and initialization response JSON documents are built by the
+ * ARINC-615A loader only when a callback is registered with it, so the
+ * internal callbacks are only registered while the application has a
+ * callback that needs them.
+ */
+static CommunicationOperationResult updateUploadInitializationResponseRegistration(
+    CommunicationHandlerPtr handler)
+{
+    bool needed = handler->_uploadInitializationResponseCallback != nullptr ||
+                  handler->_uploadInitializationResponseTypedCallback != nullptr;
+    return handler->communicationManager->registerUploadInitializationResponseCallback(
+        needed ? uploadInitializationResponseCbk : nullptr,
+        needed ? handler : nullptr);
+}
+
+static CommunicationOperationResult updateUploadInformationStatusRegistration(
+    CommunicationHandlerPtr handler)
+{
+    bool needed = handler->_uploadInformationStatusCallback != nullptr ||
+                  handler->_uploadInformationStatusTypedCallback != nullptr ||
+                  handler->_uploadCheckpointEnabled ||
+                  handler->_uploadRetryPolicy.retryableStatusCodesSize > 0;
+    return handler->communicationManager->registerUploadInformationStatusCallback(
+        needed ? uploadInformationStatusCbk : nullptr,
+        needed ? handler : nullptr);
+}
+
 CommunicationOperationResult create_handler(CommunicationHandlerPtr *handler)
 {
     if (handler == NULL)
@@ -150,12 +628,16 @@ CommunicationOperationResult create_handler(CommunicationHandlerPtr *handler)
         return COMMUNICATION_OPERATION_ERROR;
     }
 
-    // Seems like a good enough id for now
-    newHandler->id = (unsigned long)time(NULL);
     newHandler->communicationManager = new CommunicationManager();
     newHandler->authenticationManager = new AuthenticationManager();
+    newHandler->_callbackHandler = newHandler;
+
+    // The find new device callback is registered when a find starts, only
+    // if the device table or the application needs the devices.
+    newHandler->communicationManager->registerFindFinishedCallback(findFinishedCbk,
+                                                                   newHandler);
 
-    handlers[newHandler->id] = newHandler;
+    newHandler->id = handlers.add(newHandler);
 
     *handler = newHandler;
 
@@ -164,28 +646,117 @@ CommunicationOperationResult create_handler(CommunicationHandlerPtr *handler)
 
 CommunicationOperationResult destroy_handler(CommunicationHandlerPtr *handler)
 {
-    if (handler == NULL)
+    if (handler == NULL || (*handler) == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    // From here on the handler can't be found by id anymore. Unknown and
+    // already destroyed handlers are refused before they're dereferenced.
+    if (!handlers.retire(*handler))
     {
         return COMMUNICATION_OPERATION_ERROR;
     }
 
+    {
+        // Running asynchronous uploads use the managers, abort them and
+        // wait for them.
+        std::lock_guard<std::mutex> lock((*handler)->_asyncUploadMutex);
+        if ((*handler)->_asyncUpload != nullptr)
+        {
+            cancelAsyncUpload((*handler)->_asyncUpload);
+            joinAsyncUploadWorker((*handler)->_asyncUpload);
+            detachAsyncUpload((*handler)->_asyncUpload);
+            (*handler)->_asyncUpload = nullptr;
+        }
+    }
+
+    // A find that outlived its deadline still uses the managers.
+    if ((*handler)->_findWorker.joinable())
+    {
+        (*handler)->_findWorker.join();
+    }
+
+    // The workers are stopped, so the statistics are final. The handler
+    // leaves the registry as they're merged, so metrics count them once.
+    {
+        std::lock_guard<std::mutex> retiredLock(retiredStatsMutex);
+        handlers.remove(*handler);
+        std::lock_guard<std::mutex> lock((*handler)->_statsMutex);
+        Statistics::merge(&retiredStats, (*handler)->_stats);
+    }
+
     delete (*handler)->communicationManager;
     delete (*handler)->authenticationManager;
+    delete (*handler);
 
-    handlers.erase((*handler)->id);
     (*handler) = NULL;
 
     return COMMUNICATION_OPERATION_OK;
 }
 
-CommunicationOperationResult set_tftp_dataloader_server_port(
-    CommunicationHandlerPtr handler, unsigned short port)
+CommunicationOperationResult get_handler_id(
+    CommunicationHandlerPtr handler, uint64_t *id)
 {
-    if (handler == NULL || handler->communicationManager == NULL)
+    if (handler == NULL || id == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    *id = handler->id;
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult get_handler_by_id(
+    uint64_t id, CommunicationHandlerPtr *handler)
+{
+    if (handler == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    *handler = handlers.acquire(id);
+    return (*handler) != NULL ? COMMUNICATION_OPERATION_OK
+                              : COMMUNICATION_OPERATION_ERROR;
+}
+
+CommunicationOperationResult release_handler(CommunicationHandlerPtr handler)
+{
+    if (handler == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    return handlers.release(handler) ? COMMUNICATION_OPERATION_OK
+                                     : COMMUNICATION_OPERATION_ERROR;
+}
+
+CommunicationOperationResult get_handler_stats(
+    CommunicationHandlerPtr handler, HandlerStats *stats)
+{
+    if (handler == NULL || stats == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    std::lock_guard<std::mutex> lock(handler->_statsMutex);
+    *stats = handler->_stats;
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult reset_handler_stats(
+    CommunicationHandlerPtr handler)
+{
+    if (handler == NULL)
     {
         return COMMUNICATION_OPERATION_ERROR;
     }
+    std::lock_guard<std::mutex> retiredLock(retiredStatsMutex);
+    std::lock_guard<std::mutex> lock(handler->_statsMutex);
+    Statistics::merge(&retiredStats, handler->_stats);
+    handler->_stats = HandlerStats();
+    return COMMUNICATION_OPERATION_OK;
+}
 
+static CommunicationOperationResult applyTftpDataLoaderServerPort(
+    CommunicationHandlerPtr handler, unsigned short port)
+{
     CommunicationOperationResult authenticationResult =
         handler->authenticationManager->setTftpDataLoaderServerPort(port);
     CommunicationOperationResult communicationResult =
@@ -200,6 +771,48 @@ CommunicationOperationResult set_tftp_dataloader_server_port(
     return COMMUNICATION_OPERATION_ERROR;
 }
 
+CommunicationOperationResult set_tftp_dataloader_server_port(
+    CommunicationHandlerPtr handler, unsigned short port)
+{
+    if (handler == NULL || handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    handler->_tftpDataLoaderServerPort = port;
+    handler->_tftpDataLoaderServerPortAuto = port == TFTP_DATALOADER_SERVER_PORT_AUTO;
+
+    // Automatic ports are applied to the managers when the upload starts.
+    if (handler->_tftpDataLoaderServerPortAuto)
+    {
+        return COMMUNICATION_OPERATION_OK;
+    }
+
+    return applyTftpDataLoaderServerPort(handler, port);
+}
+
+CommunicationOperationResult get_tftp_dataloader_server_port(
+    CommunicationHandlerPtr handler, unsigned short *port)
+{
+    if (handler == NULL || port == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    *port = handler->_tftpDataLoaderServerPortAuto
+                ? handler->_tftpDataLoaderServerPortAllocated.load()
+                : handler->_tftpDataLoaderServerPort;
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult set_tftp_dataloader_port_range(
+    unsigned short first_port, unsigned short last_port)
+{
+    return dataLoaderPorts.setRange(first_port, last_port)
+               ? COMMUNICATION_OPERATION_OK
+               : COMMUNICATION_OPERATION_ERROR;
+}
+
 CommunicationOperationResult set_tftp_targethardware_server_port(
     CommunicationHandlerPtr handler, unsigned short port)
 {
@@ -208,6 +821,8 @@ CommunicationOperationResult set_tftp_targethardware_server_port(
         return COMMUNICATION_OPERATION_ERROR;
     }
 
+    handler->_tftpTargetHardwareServerPort = port;
+
     CommunicationOperationResult authenticationResult =
         handler->authenticationManager->setTftpTargetHardwareServerPort(port);
     CommunicationOperationResult communicationResult =
@@ -230,11 +845,66 @@ CommunicationOperationResult set_certificate(
         return COMMUNICATION_OPERATION_ERROR;
     }
 
+    handler->_certificate = certificate;
+    handler->_certificateSet = true;
     handler->authenticationManager->setCertificate(certificate);
 
     return COMMUNICATION_OPERATION_OK;
 }
 
+CommunicationOperationResult set_authentication_session_ttl(
+    CommunicationHandlerPtr handler, unsigned int ttl_s)
+{
+    if (handler == NULL || handler->authenticationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    handler->_authenticationSessionTtl = ttl_s;
+    return handler->authenticationManager->setSessionTtl(ttl_s);
+}
+
+CommunicationOperationResult set_authentication_encryption_workers(
+    CommunicationHandlerPtr handler, unsigned int workers)
+{
+    if (handler == NULL || handler->authenticationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    handler->_authenticationEncryptionWorkers = workers;
+    handler->_authenticationEncryptionWorkersSet = true;
+    return handler->authenticationManager->setEncryptionWorkers(workers);
+}
+
+CommunicationOperationResult set_authentication_ciphertext_format(
+    CommunicationHandlerPtr handler, CiphertextFormat format)
+{
+    if (handler == NULL || handler->authenticationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    CommunicationOperationResult result =
+        handler->authenticationManager->setCiphertextFormat(format);
+    if (result == COMMUNICATION_OPERATION_OK)
+    {
+        handler->_authenticationCiphertextFormat = format;
+    }
+    return result;
+}
+
+CommunicationOperationResult invalidate_authentication_session(
+    CommunicationHandlerPtr handler)
+{
+    if (handler == NULL || handler->authenticationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    return handler->authenticationManager->invalidateSession();
+}
+
 CommunicationOperationResult register_find_started_callback(
     CommunicationHandlerPtr handler, find_started callback, void *context)
 {
@@ -245,7 +915,7 @@ CommunicationOperationResult register_find_started_callback(
     handler->_findStartedCallback = callback;
     handler->_findStartedContext = context;
     return handler->communicationManager->registerFindStartedCallback(findStartedCbk,
-                                                                      handlers[handler->id]);
+                                                                      handler);
 }
 
 CommunicationOperationResult register_find_finished_callback(
@@ -258,7 +928,7 @@ CommunicationOperationResult register_find_finished_callback(
     handler->_findFinishedCallback = callback;
     handler->_findFinishedContext = context;
     return handler->communicationManager->registerFindFinishedCallback(findFinishedCbk,
-                                                                       handlers[handler->id]);
+                                                                       handler);
 }
 
 CommunicationOperationResult register_find_new_device_callback(
@@ -270,40 +940,235 @@ CommunicationOperationResult register_find_new_device_callback(
     }
     handler->_findNewDeviceCallback = callback;
     handler->_findNewDeviceContext = context;
-    return handler->communicationManager->registerFindNewDeviceCallback(findNewDeviceCbk,
-                                                                        handlers[handler->id]);
+    return COMMUNICATION_OPERATION_OK;
 }
 
-CommunicationOperationResult find(CommunicationHandlerPtr handler)
+CommunicationOperationResult register_find_new_devices_batch_callback(
+    CommunicationHandlerPtr handler, find_new_devices_batch_callback callback,
+    void *context, size_t max_batch_size, unsigned int max_batch_delay_ms)
 {
-    if (handler == NULL ||
-        // handler->authenticationManager == NULL ||
-        handler->communicationManager == NULL)
+    if (handler == NULL || (callback != nullptr && max_batch_size == 0))
     {
         return COMMUNICATION_OPERATION_ERROR;
     }
-    // if (handler->authenticationManager->authenticate() == COMMUNICATION_OPERATION_OK)
-    // {
-    return handler->communicationManager->find();
-    // }
-    // return COMMUNICATION_OPERATION_ERROR;
+
+    std::lock_guard<std::mutex> lock(handler->_findBatchMutex);
+    handler->_findNewDevicesBatchCallback = callback;
+    handler->_findNewDevicesBatchContext = context;
+    handler->_findBatchSize = max_batch_size;
+    handler->_findBatchWindowMs = max_batch_delay_ms;
+    handler->_findBatch.clear();
+    handler->_findBatch.reserve(max_batch_size);
+    return COMMUNICATION_OPERATION_OK;
 }
 
-CommunicationOperationResult set_target_hardware_id(
-    CommunicationHandlerPtr handler, const char *target_id)
+CommunicationOperationResult set_find_report_changes_only(
+    CommunicationHandlerPtr handler, int enabled)
 {
-    if (handler == NULL || handler->communicationManager == NULL)
+    if (handler == NULL)
     {
         return COMMUNICATION_OPERATION_ERROR;
     }
-    CommunicationOperationResult authenticationResult =
-        handler->authenticationManager->setTargetHardwareId(target_id);
-    CommunicationOperationResult communicationResult =
-        handler->communicationManager->setTargetHardwareId(target_id);
+    handler->_findReportChangesOnly = enabled != 0;
+    return COMMUNICATION_OPERATION_OK;
+}
 
-    if (authenticationResult == COMMUNICATION_OPERATION_OK &&
-        communicationResult == COMMUNICATION_OPERATION_OK)
-    {
+CommunicationOperationResult set_device_cache_file(const char *path)
+{
+    return DeviceTable::getInstance().setPersistencePath(path != NULL ? path : "")
+               ? COMMUNICATION_OPERATION_OK
+               : COMMUNICATION_OPERATION_ERROR;
+}
+
+CommunicationOperationResult get_cached_devices(
+    DiscoveredDevice *devices, size_t *devices_size)
+{
+    if (devices_size == NULL || (devices == NULL && *devices_size > 0))
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    std::vector<DeviceTable::Device> cachedDevices = DeviceTable::getInstance().list();
+    size_t capacity = *devices_size;
+    *devices_size = cachedDevices.size();
+    if (capacity < cachedDevices.size())
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    for (size_t i = 0; i < cachedDevices.size(); ++i)
+    {
+        copyDevice(&devices[i], cachedDevices[i]);
+    }
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult get_cached_device(
+    const char *target_hardware_id, const char *target_hardware_pos,
+    DiscoveredDevice *device)
+{
+    DeviceTable::Device cachedDevice;
+    if (target_hardware_id == NULL || target_hardware_pos == NULL || device == NULL ||
+        !DeviceTable::getInstance().lookup(target_hardware_id, target_hardware_pos,
+                                           cachedDevice))
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    copyDevice(device, cachedDevice);
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult clear_device_cache()
+{
+    DeviceTable::getInstance().clear();
+    return DeviceTable::getInstance().flush() ? COMMUNICATION_OPERATION_OK
+                                              : COMMUNICATION_OPERATION_ERROR;
+}
+
+static bool startFind(CommunicationHandlerPtr handler)
+{
+    {
+        std::lock_guard<std::mutex> lock(handler->_findMutex);
+        if (handler->_findWorkerRunning)
+        {
+            return false;
+        }
+        handler->_findDone = false;
+        handler->_findFinishedReported = false;
+        handler->_findExpired = false;
+    }
+
+    // Devices are parsed to be recorded in a persisted device cache, to
+    // tell changes apart, or to be batched.
+    bool batched;
+    {
+        std::lock_guard<std::mutex> lock(handler->_findBatchMutex);
+        batched = handler->_findNewDevicesBatchCallback != nullptr;
+    }
+    handler->_findParseDevices = batched ||
+                                 handler->_findReportChangesOnly ||
+                                 DeviceTable::getInstance().isPersistent();
+    bool needed = handler->_findParseDevices ||
+                  handler->_findNewDeviceCallback != nullptr;
+    handler->communicationManager->registerFindNewDeviceCallback(
+        needed ? findNewDeviceCbk : nullptr,
+        needed ? handler : nullptr);
+    return true;
+}
+
+CommunicationOperationResult find(CommunicationHandlerPtr handler)
+{
+    if (handler == NULL ||
+        // handler->authenticationManager == NULL ||
+        handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    if (!startFind(handler))
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    // if (handler->authenticationManager->authenticate() == COMMUNICATION_OPERATION_OK)
+    // {
+    return handler->communicationManager->find();
+    // }
+    // return COMMUNICATION_OPERATION_ERROR;
+}
+
+CommunicationOperationResult find_with_deadline(
+    CommunicationHandlerPtr handler, unsigned int deadline_ms)
+{
+    if (handler == NULL || handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(deadline_ms);
+
+    // A find that outlived its deadline may still be running.
+    {
+        std::unique_lock<std::mutex> lock(handler->_findMutex);
+        if (!handler->_findCondition.wait_until(lock, deadline, [handler]
+                                                { return !handler->_findWorkerRunning; }))
+        {
+            return COMMUNICATION_OPERATION_ERROR;
+        }
+    }
+    if (handler->_findWorker.joinable())
+    {
+        handler->_findWorker.join();
+    }
+
+    if (!startFind(handler))
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    {
+        std::lock_guard<std::mutex> lock(handler->_findMutex);
+        handler->_findWorkerRunning = true;
+        handler->_findResult = COMMUNICATION_OPERATION_OK;
+    }
+    handler->_findWorker = std::thread([handler]()
+                                       {
+        CommunicationOperationResult result = handler->communicationManager->find();
+        {
+            std::lock_guard<std::mutex> lock(handler->_findMutex);
+            if (result != COMMUNICATION_OPERATION_OK)
+            {
+                handler->_findResult = result;
+                handler->_findDone = true;
+            }
+            handler->_findWorkerRunning = false;
+        }
+        handler->_findCondition.notify_all(); });
+
+    bool report;
+    CommunicationOperationResult result;
+    {
+        std::unique_lock<std::mutex> lock(handler->_findMutex);
+        if (handler->_findCondition.wait_until(lock, deadline, [handler]
+                                               { return handler->_findDone; }))
+        {
+            // The find returns right after it reports it finished, wait for
+            // it so a new find can start as soon as we return.
+            result = handler->_findResult;
+            lock.unlock();
+            handler->_findWorker.join();
+            return result;
+        }
+
+        // Devices found from now on are only recorded in the device cache.
+        handler->_findExpired = true;
+        report = !handler->_findFinishedReported;
+        handler->_findFinishedReported = true;
+        result = handler->_findResult;
+    }
+
+    flushFindBatch(handler);
+
+    if (report && handler->_findFinishedCallback != nullptr)
+    {
+        CallbackTimer timer(handler);
+        handler->_findFinishedCallback(handler, handler->_findFinishedContext);
+    }
+    return result;
+}
+
+CommunicationOperationResult set_target_hardware_id(
+    CommunicationHandlerPtr handler, const char *target_id)
+{
+    if (handler == NULL || handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    CommunicationOperationResult authenticationResult =
+        handler->authenticationManager->setTargetHardwareId(target_id);
+    CommunicationOperationResult communicationResult =
+        handler->communicationManager->setTargetHardwareId(target_id);
+
+    if (authenticationResult == COMMUNICATION_OPERATION_OK &&
+        communicationResult == COMMUNICATION_OPERATION_OK)
+    {
         return COMMUNICATION_OPERATION_OK;
     }
     return COMMUNICATION_OPERATION_ERROR;
@@ -349,12 +1214,76 @@ CommunicationOperationResult set_target_hardware_ip(
     return COMMUNICATION_OPERATION_ERROR;
 }
 
+CommunicationOperationResult set_target_hardware_from_cache(
+    CommunicationHandlerPtr handler, const char *target_id, const char *target_pos)
+{
+    DiscoveredDevice device;
+    if (handler == NULL ||
+        get_cached_device(target_id, target_pos, &device) != COMMUNICATION_OPERATION_OK)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    if (set_target_hardware_id(handler, device.targetHardwareId) == COMMUNICATION_OPERATION_OK &&
+        set_target_hardware_pos(handler, device.targetPosition) == COMMUNICATION_OPERATION_OK &&
+        set_target_hardware_ip(handler, device.ip) == COMMUNICATION_OPERATION_OK)
+    {
+        return COMMUNICATION_OPERATION_OK;
+    }
+    return COMMUNICATION_OPERATION_ERROR;
+}
+
 CommunicationOperationResult set_load_list(
     CommunicationHandlerPtr handler, Load *load_list, size_t load_list_size)
 {
+    if (handler == NULL || handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
     return handler->communicationManager->setLoadList(load_list, load_list_size);
 }
 
+CommunicationOperationResult add_load(
+    CommunicationHandlerPtr handler, const Load *load)
+{
+    if (handler == NULL || handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    return handler->communicationManager->addLoad(load);
+}
+
+CommunicationOperationResult remove_load(
+    CommunicationHandlerPtr handler, const char *load_name)
+{
+    if (handler == NULL || handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    return handler->communicationManager->removeLoad(load_name);
+}
+
+CommunicationOperationResult clear_load_list(
+    CommunicationHandlerPtr handler)
+{
+    if (handler == NULL || handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    return handler->communicationManager->clearLoadList();
+}
+
+CommunicationOperationResult get_load_checksums(
+    CommunicationHandlerPtr handler, LoadChecksum *checksums,
+    size_t *checksums_size)
+{
+    if (handler == NULL || handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    return handler->communicationManager->getLoadChecksums(checksums, checksums_size);
+}
+
 CommunicationOperationResult register_upload_initialization_response_callback(
     CommunicationHandlerPtr handler,
     upload_initialization_response_callback callback, void *context)
@@ -365,8 +1294,7 @@ CommunicationOperationResult register_upload_initialization_response_callback(
     }
     handler->_uploadInitializationResponseCallback = callback;
     handler->_uploadInitializationResponseContext = context;
-    return handler->communicationManager->registerUploadInitializationResponseCallback(uploadInitializationResponseCbk,
-                                                                                       handlers[handler->id]);
+    return updateUploadInitializationResponseRegistration(handler);
 }
 
 CommunicationOperationResult register_upload_information_status_callback(
@@ -379,8 +1307,33 @@ CommunicationOperationResult register_upload_information_status_callback(
     }
     handler->_uploadInformationStatusCallback = callback;
     handler->_uploadInformationStatusContext = context;
-    return handler->communicationManager->registerUploadInformationStatusCallback(uploadInformationStatusCbk,
-                                                                                  handlers[handler->id]);
+    return updateUploadInformationStatusRegistration(handler);
+}
+
+CommunicationOperationResult register_upload_initialization_response_typed_callback(
+    CommunicationHandlerPtr handler,
+    upload_initialization_response_typed_callback callback, void *context)
+{
+    if (handler == NULL || handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    handler->_uploadInitializationResponseTypedCallback = callback;
+    handler->_uploadInitializationResponseTypedContext = context;
+    return updateUploadInitializationResponseRegistration(handler);
+}
+
+CommunicationOperationResult register_upload_information_status_typed_callback(
+    CommunicationHandlerPtr handler,
+    upload_information_status_typed_callback callback, void *context)
+{
+    if (handler == NULL || handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    handler->_uploadInformationStatusTypedCallback = callback;
+    handler->_uploadInformationStatusTypedContext = context;
+    return updateUploadInformationStatusRegistration(handler);
 }
 
 CommunicationOperationResult register_file_not_available_callback(
@@ -395,10 +1348,10 @@ CommunicationOperationResult register_file_not_available_callback(
     handler->_fileNotAvailableContext = context;
     CommunicationOperationResult authenticationResult =
         handler->authenticationManager->registerCertificateNotAvailableCallback(certificateNotAvailableCbk,
-                                                                                handlers[handler->id]);
+                                                                                handler);
     CommunicationOperationResult communicationResult =
         handler->communicationManager->registerFileNotAvailableCallback(fileNotAvailableCbk,
-                                                                        handlers[handler->id]);
+                                                                        handler);
 
     if (authenticationResult == COMMUNICATION_OPERATION_OK &&
         communicationResult == COMMUNICATION_OPERATION_OK)
@@ -408,7 +1361,174 @@ CommunicationOperationResult register_file_not_available_callback(
     return COMMUNICATION_OPERATION_ERROR;
 }
 
-CommunicationOperationResult upload(CommunicationHandlerPtr handler)
+static unsigned int uploadRetryBackoff(const UploadRetryPolicy &policy,
+                                       unsigned int failures)
+{
+    // A maxBackoffMs of 0 doesn't cap the backoff, which is still bounded
+    // by what fits the delay.
+    uint64_t maxBackoffMs = policy.maxBackoffMs > 0 ? policy.maxBackoffMs : UINT_MAX;
+    uint64_t backoffMs = policy.initialBackoffMs;
+    for (unsigned int i = 1; i < failures && backoffMs < maxBackoffMs; ++i)
+    {
+        backoffMs *= std::max(policy.backoffMultiplier, 1u);
+    }
+    backoffMs = std::min(backoffMs, maxBackoffMs);
+
+    unsigned int jitterPercent = std::min(policy.jitterPercent, 100u);
+    if (jitterPercent > 0 && backoffMs > 0)
+    {
+        static thread_local std::mt19937 generator(std::random_device{}());
+        std::uniform_int_distribution<uint64_t> jitter(0, backoffMs * jitterPercent / 100);
+        backoffMs -= jitter(generator);
+    }
+    return (unsigned int)backoffMs;
+}
+
+static bool isRetryableTransferFailure(CommunicationHandlerPtr handler)
+{
+    const UploadRetryPolicy &policy = handler->_uploadRetryPolicy;
+    if (policy.retryableStatusCodesSize == 0)
+    {
+        return true;
+    }
+    unsigned short statusCode = handler->_lastUploadStatusCode;
+    for (size_t i = 0; i < policy.retryableStatusCodesSize; ++i)
+    {
+        if (policy.retryableStatusCodes[i] == statusCode)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void startUploadRetries(CommunicationHandlerPtr handler, UploadRetryState *state)
+{
+    state->authenticationFailures = 0;
+    state->transferFailures = 0;
+}
+
+/*
+ * Called when an upload is requested, not when it starts running, so an
+ * abort that arrives while the upload is queued still cancels it.
+ */
+static void resetUploadCancellation(CommunicationHandlerPtr handler)
+{
+    std::lock_guard<std::mutex> lock(handler->_uploadRetryMutex);
+    handler->_uploadRetryCancelled = false;
+}
+
+/*
+ * Run a single authentication and transfer attempt. If it failed and the
+ * retry policy allows another attempt, retryDelayMs is set to the time to
+ * wait before it, otherwise it's set to -1.
+ */
+static CommunicationOperationResult runUploadAttempt(
+    CommunicationHandlerPtr handler, bool resume, UploadRetryState *state,
+    long *retryDelayMs)
+{
+    TRACE_SCOPE("upload attempt");
+    *retryDelayMs = -1;
+
+    // Aborted before it could start
+    if (handler->_uploadRetryCancelled)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    // The retry decision must only see the status codes of this attempt.
+    handler->_lastUploadStatusCode = 0;
+
+    unsigned short allocatedPort = TFTP_DATALOADER_SERVER_PORT_AUTO;
+    if (handler->_tftpDataLoaderServerPortAuto)
+    {
+        if (!dataLoaderPorts.allocate(&allocatedPort))
+        {
+            return COMMUNICATION_OPERATION_ERROR;
+        }
+        if (applyTftpDataLoaderServerPort(handler, allocatedPort) != COMMUNICATION_OPERATION_OK)
+        {
+            dataLoaderPorts.release(allocatedPort);
+            return COMMUNICATION_OPERATION_ERROR;
+        }
+        handler->_tftpDataLoaderServerPortAllocated = allocatedPort;
+    }
+
+    CommunicationOperationResult result = COMMUNICATION_OPERATION_ERROR;
+    auto authenticationStart = std::chrono::steady_clock::now();
+    bool authenticated = handler->authenticationManager->authenticate() == COMMUNICATION_OPERATION_OK;
+    auto transferStart = std::chrono::steady_clock::now();
+    uint64_t encryptionUs = handler->authenticationManager->takeEncryptionTimeUs();
+    {
+        std::lock_guard<std::mutex> lock(handler->_statsMutex);
+        handler->_stats.authentications++;
+        handler->_stats.authenticationFailures += authenticated ? 0 : 1;
+        Statistics::recordLatency(&handler->_stats.authenticationLatency, transferStart - authenticationStart);
+        if (encryptionUs > 0)
+        {
+            Statistics::recordLatency(&handler->_stats.encryptionLatency,
+                                      std::chrono::microseconds(encryptionUs));
+        }
+        handler->_statsInitializationPending = authenticated;
+        handler->_statsTransferStart = transferStart;
+        handler->_statsLastStatus = std::chrono::steady_clock::time_point();
+    }
+
+    if (authenticated)
+    {
+        result = resume ? handler->communicationManager->resumeUpload()
+                        : handler->communicationManager->upload();
+        {
+            std::lock_guard<std::mutex> lock(handler->_statsMutex);
+            Statistics::recordLatency(&handler->_stats.transferLatency,
+                                      std::chrono::steady_clock::now() - transferStart);
+            if (result == COMMUNICATION_OPERATION_OK)
+            {
+                handler->_stats.bytesSent += handler->communicationManager->getUploadBytes();
+            }
+            handler->_statsInitializationPending = false;
+        }
+        if (result != COMMUNICATION_OPERATION_OK && handler->_authenticationSessionTtl > 0)
+        {
+            // The TargetHardware may have dropped the session, don't reuse it.
+            handler->authenticationManager->invalidateSession();
+        }
+    }
+
+    if (allocatedPort != TFTP_DATALOADER_SERVER_PORT_AUTO)
+    {
+        handler->_tftpDataLoaderServerPortAllocated = TFTP_DATALOADER_SERVER_PORT_AUTO;
+        dataLoaderPorts.release(allocatedPort);
+    }
+
+    if (result == COMMUNICATION_OPERATION_OK || handler->_uploadRetryCancelled)
+    {
+        return result;
+    }
+
+    const UploadRetryPolicy &policy = handler->_uploadRetryPolicy;
+    if (!authenticated)
+    {
+        if (++state->authenticationFailures < policy.maxAuthenticationAttempts)
+        {
+            *retryDelayMs = uploadRetryBackoff(policy, state->authenticationFailures);
+        }
+    }
+    else if (++state->transferFailures < policy.maxTransferAttempts &&
+             isRetryableTransferFailure(handler))
+    {
+        *retryDelayMs = uploadRetryBackoff(policy, state->transferFailures);
+    }
+
+    if (*retryDelayMs >= 0)
+    {
+        std::lock_guard<std::mutex> lock(handler->_statsMutex);
+        handler->_stats.retries++;
+    }
+    return result;
+}
+
+static CommunicationOperationResult runUpload(CommunicationHandlerPtr handler, bool resume)
 {
     if (handler == NULL ||
         handler->authenticationManager == NULL ||
@@ -416,11 +1536,88 @@ CommunicationOperationResult upload(CommunicationHandlerPtr handler)
     {
         return COMMUNICATION_OPERATION_ERROR;
     }
-    if (handler->authenticationManager->authenticate() == COMMUNICATION_OPERATION_OK)
+
+    activeUploads++;
+    auto start = std::chrono::steady_clock::now();
+    CommunicationOperationResult result;
+    UploadRetryState state;
+    startUploadRetries(handler, &state);
+    while (true)
     {
-        return handler->communicationManager->upload();
+        long retryDelayMs;
+        result = runUploadAttempt(handler, resume, &state, &retryDelayMs);
+        if (retryDelayMs < 0)
+        {
+            break;
+        }
+
+        // abort_upload wakes us up and cancels the retry.
+        TRACE_SCOPE("upload retry backoff");
+        std::unique_lock<std::mutex> lock(handler->_uploadRetryMutex);
+        if (handler->_uploadRetryCondition.wait_for(lock,
+                                                    std::chrono::milliseconds(retryDelayMs),
+                                                    [handler]
+                                                    { return handler->_uploadRetryCancelled.load(); }))
+        {
+            break;
+        }
+        resume = resume || handler->_uploadCheckpointEnabled;
     }
-    return COMMUNICATION_OPERATION_ERROR;
+
+    recordUpload(handler, start, result);
+    return result;
+}
+
+CommunicationOperationResult upload(CommunicationHandlerPtr handler)
+{
+    if (handler == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    resetUploadCancellation(handler);
+    return runUpload(handler, false);
+}
+
+CommunicationOperationResult set_upload_checkpoint(
+    CommunicationHandlerPtr handler, int enabled)
+{
+    if (handler == NULL || handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    handler->_uploadCheckpointEnabled = enabled != 0;
+    return updateUploadInformationStatusRegistration(handler);
+}
+
+CommunicationOperationResult resume_upload(CommunicationHandlerPtr handler)
+{
+    if (handler == NULL || !handler->_uploadCheckpointEnabled)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    resetUploadCancellation(handler);
+    return runUpload(handler, true);
+}
+
+CommunicationOperationResult set_upload_retry_policy(
+    CommunicationHandlerPtr handler, const UploadRetryPolicy *policy)
+{
+    if (handler == NULL || handler->communicationManager == NULL ||
+        (policy != NULL && policy->retryableStatusCodesSize > MAX_RETRYABLE_STATUS_CODES))
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    if (policy != NULL)
+    {
+        handler->_uploadRetryPolicy = *policy;
+    }
+    else
+    {
+        handler->_uploadRetryPolicy = UploadRetryPolicy();
+    }
+    return updateUploadInformationStatusRegistration(handler);
 }
 
 CommunicationOperationResult abort_upload(
@@ -433,6 +1630,14 @@ CommunicationOperationResult abort_upload(
         return COMMUNICATION_OPERATION_ERROR;
     }
 
+    TRACE_SCOPE("abort upload");
+    {
+        std::lock_guard<std::mutex> lock(handler->_uploadRetryMutex);
+        handler->_uploadRetryCancelled = true;
+    }
+    handler->_uploadRetryCondition.notify_all();
+    wakeAsyncUploadWorkers();
+
     CommunicationOperationResult authenticationReturn = handler->authenticationManager->abortAuthentication(abortSource);
     CommunicationOperationResult uploadReturn = handler->communicationManager->abortUpload(abortSource);
 
@@ -442,4 +1647,687 @@ CommunicationOperationResult abort_upload(
         return COMMUNICATION_OPERATION_OK;
     }
     return COMMUNICATION_OPERATION_ERROR;
-}
\ No newline at end of file
+}
+
+static void finishAsyncUpload(struct AsyncUpload *operation,
+                              CommunicationOperationResult result)
+{
+    {
+        std::lock_guard<std::mutex> lock(operation->mutex);
+        operation->result = result;
+        operation->finished = true;
+    }
+    operation->finishedCondition.notify_all();
+
+    uint64_t signal = 1;
+    if (write(operation->eventFd, &signal, sizeof(signal)) != sizeof(signal))
+    {
+        // Nothing to do, waiters are still notified through the condition.
+    }
+}
+
+static void asyncUploadWorker(struct AsyncUpload *operation)
+{
+    finishAsyncUpload(operation, runUpload(operation->handler, operation->resume));
+}
+
+/*
+ * Run one attempt of an asynchronous upload on a shared worker. Returns false
+ * if a retry was scheduled, the operation must then be queued again to run
+ * at its retry time.
+ */
+static bool asyncUploadStep(struct AsyncUpload *operation,
+                            std::chrono::steady_clock::time_point *retryAt)
+{
+    CommunicationHandlerPtr handler = operation->handler;
+    if (!operation->started)
+    {
+        startUploadRetries(handler, &operation->retryState);
+        operation->started = true;
+        operation->startedAt = std::chrono::steady_clock::now();
+        activeUploads++;
+    }
+    else if (handler->_uploadRetryCancelled)
+    {
+        recordUpload(handler, operation->startedAt, operation->attemptResult);
+        finishAsyncUpload(operation, operation->attemptResult);
+        return true;
+    }
+
+    long retryDelayMs;
+    operation->attemptResult = runUploadAttempt(handler, operation->resume,
+                                                &operation->retryState, &retryDelayMs);
+    if (retryDelayMs < 0)
+    {
+        recordUpload(handler, operation->startedAt, operation->attemptResult);
+        finishAsyncUpload(operation, operation->attemptResult);
+        return true;
+    }
+
+    operation->resume = operation->resume || handler->_uploadCheckpointEnabled;
+    *retryAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(retryDelayMs);
+    return false;
+}
+
+bool AsyncUpload::step(std::chrono::steady_clock::time_point *retryAt)
+{
+    return asyncUploadStep(this, retryAt);
+}
+
+bool AsyncUpload::isCancelled()
+{
+    return handler->_uploadRetryCancelled;
+}
+
+void AsyncUpload::abandon()
+{
+    if (started)
+    {
+        recordUpload(handler, startedAt, COMMUNICATION_OPERATION_ERROR);
+    }
+    finishAsyncUpload(this, COMMUNICATION_OPERATION_ERROR);
+}
+
+// Shared workers of the asynchronous uploads, see set_async_upload_workers.
+static AsyncUploadPool asyncUploadPool;
+
+static void joinAsyncUploadWorker(struct AsyncUpload *operation)
+{
+    if (operation->worker.joinable())
+    {
+        operation->worker.join();
+    }
+    asyncUploadPool.wait(operation);
+}
+
+// Abort an operation that is still running, so it can be joined right away.
+static void cancelAsyncUpload(struct AsyncUpload *operation)
+{
+    bool finished;
+    {
+        std::lock_guard<std::mutex> lock(operation->mutex);
+        finished = operation->finished;
+    }
+    if (!finished && operation->handler != nullptr)
+    {
+        abort_upload(operation->handler, OPERATION_ABORTED_BY_THE_DATALOADER);
+    }
+}
+
+/*
+ * Unlink an operation from its handler, with the handler's asynchronous
+ * upload lock held. upload_async_release may be waiting for it, see there.
+ */
+static void detachAsyncUpload(struct AsyncUpload *operation)
+{
+    {
+        std::lock_guard<std::mutex> lock(operation->mutex);
+        operation->handler = nullptr;
+    }
+    operation->finishedCondition.notify_all();
+}
+
+static void wakeAsyncUploadWorkers()
+{
+    asyncUploadPool.wake();
+}
+
+CommunicationOperationResult set_async_upload_workers(unsigned int workers)
+{
+    asyncUploadPool.setWorkers(workers);
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult upload_async(
+    CommunicationHandlerPtr handler, AsyncUploadPtr *operation)
+{
+    if (handler == NULL ||
+        operation == NULL ||
+        handler->authenticationManager == NULL ||
+        handler->communicationManager == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    std::lock_guard<std::mutex> lock(handler->_asyncUploadMutex);
+    if (handler->_asyncUpload != nullptr)
+    {
+        bool finished;
+        {
+            std::lock_guard<std::mutex> operationLock(handler->_asyncUpload->mutex);
+            finished = handler->_asyncUpload->finished;
+        }
+        if (!finished)
+        {
+            return COMMUNICATION_OPERATION_ERROR;
+        }
+        // Previous operation finished but was not released yet, detach it.
+        joinAsyncUploadWorker(handler->_asyncUpload);
+        detachAsyncUpload(handler->_asyncUpload);
+        handler->_asyncUpload = nullptr;
+    }
+
+    resetUploadCancellation(handler);
+
+    struct AsyncUpload *newOperation = new AsyncUpload();
+    newOperation->handler = handler;
+    newOperation->finished = false;
+    newOperation->result = COMMUNICATION_OPERATION_ERROR;
+    newOperation->eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (newOperation->eventFd < 0)
+    {
+        delete newOperation;
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    if (!asyncUploadPool.submit(newOperation))
+    {
+        newOperation->worker = std::thread(asyncUploadWorker, newOperation);
+    }
+    handler->_asyncUpload = newOperation;
+
+    *operation = newOperation;
+
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult upload_async_poll(
+    AsyncUploadPtr operation, AsyncUploadState *state,
+    CommunicationOperationResult *result)
+{
+    return upload_async_wait(operation, 0, state, result);
+}
+
+CommunicationOperationResult upload_async_wait(
+    AsyncUploadPtr operation, int timeout_ms, AsyncUploadState *state,
+    CommunicationOperationResult *result)
+{
+    if (operation == NULL || state == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    std::unique_lock<std::mutex> lock(operation->mutex);
+    if (timeout_ms < 0)
+    {
+        operation->finishedCondition.wait(lock, [operation]
+                                          { return operation->finished; });
+    }
+    else if (timeout_ms > 0)
+    {
+        operation->finishedCondition.wait_for(lock,
+                                              std::chrono::milliseconds(timeout_ms),
+                                              [operation]
+                                              { return operation->finished; });
+    }
+
+    *state = operation->finished ? ASYNC_UPLOAD_FINISHED : ASYNC_UPLOAD_RUNNING;
+    if (result != NULL && operation->finished)
+    {
+        *result = operation->result;
+    }
+
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult upload_async_get_fd(
+    AsyncUploadPtr operation, int *fd)
+{
+    if (operation == NULL || fd == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    *fd = operation->eventFd;
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult upload_async_release(
+    AsyncUploadPtr *operation)
+{
+    if (operation == NULL || (*operation) == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    // The handler may be destroyed at the same time. It's pinned, so it
+    // stays alive until the operation is unlinked from it. If it can't be
+    // pinned, destroy_handler is aborting the operation and unlinks it.
+    CommunicationHandlerPtr handler;
+    {
+        std::unique_lock<std::mutex> lock((*operation)->mutex);
+        handler = (*operation)->handler;
+        if (handler != nullptr && !handlers.pin(handler))
+        {
+            AsyncUploadPtr detaching = *operation;
+            detaching->finishedCondition.wait(lock, [detaching]
+                                              { return detaching->handler == nullptr; });
+            handler = nullptr;
+        }
+    }
+
+    if (handler != nullptr)
+    {
+        {
+            std::lock_guard<std::mutex> lock(handler->_asyncUploadMutex);
+            cancelAsyncUpload(*operation);
+            joinAsyncUploadWorker(*operation);
+            if (handler->_asyncUpload == (*operation))
+            {
+                detachAsyncUpload(*operation);
+                handler->_asyncUpload = nullptr;
+            }
+        }
+        handlers.release(handler);
+    }
+    else
+    {
+        joinAsyncUploadWorker(*operation);
+    }
+
+    close((*operation)->eventFd);
+    delete (*operation);
+    (*operation) = NULL;
+
+    return COMMUNICATION_OPERATION_OK;
+}
+
+struct UploadBatchSlot
+{
+    CommunicationHandlerPtr handler;
+    AsyncUploadPtr operation;
+    size_t jobIndex;
+    UploadJob *jobs;
+    upload_job_status_callback callback;
+    void *context;
+    // Status callback of the template handler, called as well
+    upload_information_status_callback statusCallback;
+    void *statusContext;
+};
+
+static CommunicationOperationResult uploadBatchStatusCbk(
+    CommunicationHandlerPtr handler,
+    const char *upload_information_status_json,
+    void *context)
+{
+    struct UploadBatchSlot *slot = (struct UploadBatchSlot *)context;
+    if (slot == nullptr)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    CommunicationOperationResult result = COMMUNICATION_OPERATION_OK;
+    if (slot->statusCallback != nullptr &&
+        slot->statusCallback(handler, upload_information_status_json,
+                             slot->statusContext) != COMMUNICATION_OPERATION_OK)
+    {
+        result = COMMUNICATION_OPERATION_ERROR;
+    }
+    if (slot->callback != nullptr &&
+        slot->callback(&slot->jobs[slot->jobIndex], slot->jobIndex,
+                       upload_information_status_json,
+                       slot->context) != COMMUNICATION_OPERATION_OK)
+    {
+        result = COMMUNICATION_OPERATION_ERROR;
+    }
+    return result;
+}
+
+static CommunicationOperationResult startUploadBatchJob(
+    struct UploadBatchSlot *slot, size_t jobIndex)
+{
+    UploadJob *job = &slot->jobs[jobIndex];
+    slot->jobIndex = jobIndex;
+
+    if (set_target_hardware_id(slot->handler, job->targetHardwareId) != COMMUNICATION_OPERATION_OK ||
+        set_target_hardware_pos(slot->handler, job->targetHardwarePosition) != COMMUNICATION_OPERATION_OK ||
+        set_target_hardware_ip(slot->handler, job->targetHardwareIp) != COMMUNICATION_OPERATION_OK ||
+        set_load_list(slot->handler, job->loadList, job->loadListSize) != COMMUNICATION_OPERATION_OK)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    return upload_async(slot->handler, &slot->operation);
+}
+
+CommunicationOperationResult upload_batch(
+    CommunicationHandlerPtr handler, UploadJob *jobs, size_t jobs_size,
+    size_t max_concurrent_uploads, upload_job_status_callback callback,
+    void *context, size_t *failed_jobs)
+{
+    if (handler == NULL || jobs == NULL || max_concurrent_uploads == 0)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    size_t slotsSize = std::min(max_concurrent_uploads, jobs_size);
+
+    // Fixed DataLoader ports are taken one per slot from the template's port.
+    // They go through an allocator as well, so a port that can't be bound
+    // isn't used and the batch runs with fewer slots.
+    unsigned short firstSlotPort = handler->_tftpDataLoaderServerPort;
+    bool fixedSlotPorts = !handler->_tftpDataLoaderServerPortAuto && firstSlotPort != 0 &&
+                          slotsSize > 0;
+    if (fixedSlotPorts && (uint64_t)firstSlotPort + slotsSize - 1 > USHRT_MAX)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    PortAllocator slotPorts(firstSlotPort,
+                            fixedSlotPorts ? (unsigned short)(firstSlotPort + slotsSize - 1)
+                                           : firstSlotPort);
+
+    std::vector<struct UploadBatchSlot> slots(slotsSize);
+    for (size_t i = 0; i < slotsSize; ++i)
+    {
+        struct UploadBatchSlot *slot = &slots[i];
+        slot->operation = NULL;
+        slot->jobs = jobs;
+        slot->callback = callback;
+        slot->context = context;
+        slot->statusCallback = handler->_uploadInformationStatusCallback;
+        slot->statusContext = handler->_uploadInformationStatusContext;
+        if (create_handler(&slot->handler) != COMMUNICATION_OPERATION_OK)
+        {
+            slotsSize = i;
+            break;
+        }
+        slot->handler->_callbackHandler = handler;
+
+        // Each concurrent upload needs its own DataLoader TFTP server.
+        if (handler->_tftpDataLoaderServerPortAuto)
+        {
+            set_tftp_dataloader_server_port(slot->handler,
+                                            TFTP_DATALOADER_SERVER_PORT_AUTO);
+        }
+        else if (fixedSlotPorts)
+        {
+            unsigned short port = 0;
+            if (!slotPorts.allocate(&port))
+            {
+                destroy_handler(&slot->handler);
+                slotsSize = i;
+                break;
+            }
+            set_tftp_dataloader_server_port(slot->handler, port);
+        }
+        if (handler->_tftpTargetHardwareServerPort != 0)
+        {
+            set_tftp_targethardware_server_port(slot->handler,
+                                                handler->_tftpTargetHardwareServerPort);
+        }
+        if (handler->_certificateSet)
+        {
+            set_certificate(slot->handler, handler->_certificate);
+        }
+        if (handler->_authenticationSessionTtl > 0)
+        {
+            set_authentication_session_ttl(slot->handler,
+                                           handler->_authenticationSessionTtl);
+        }
+        if (handler->_authenticationEncryptionWorkersSet)
+        {
+            set_authentication_encryption_workers(slot->handler,
+                                                  handler->_authenticationEncryptionWorkers);
+        }
+        if (handler->_authenticationCiphertextFormat != CIPHERTEXT_FORMAT_ADVANCED)
+        {
+            set_authentication_ciphertext_format(slot->handler,
+                                                 handler->_authenticationCiphertextFormat);
+        }
+        if (handler->_uploadCheckpointEnabled)
+        {
+            set_upload_checkpoint(slot->handler, 1);
+        }
+        if (handler->_uploadRetryPolicy.maxAuthenticationAttempts > 1 ||
+            handler->_uploadRetryPolicy.maxTransferAttempts > 1)
+        {
+            set_upload_retry_policy(slot->handler, &handler->_uploadRetryPolicy);
+        }
+        if (handler->_fileNotAvailableCallback != nullptr)
+        {
+            register_file_not_available_callback(slot->handler,
+                                                 handler->_fileNotAvailableCallback,
+                                                 handler->_fileNotAvailableContext);
+        }
+        if (handler->_uploadInitializationResponseCallback != nullptr)
+        {
+            register_upload_initialization_response_callback(
+                slot->handler, handler->_uploadInitializationResponseCallback,
+                handler->_uploadInitializationResponseContext);
+        }
+        if (handler->_uploadInitializationResponseTypedCallback != nullptr)
+        {
+            register_upload_initialization_response_typed_callback(
+                slot->handler, handler->_uploadInitializationResponseTypedCallback,
+                handler->_uploadInitializationResponseTypedContext);
+        }
+        if (handler->_uploadInformationStatusTypedCallback != nullptr)
+        {
+            register_upload_information_status_typed_callback(
+                slot->handler, handler->_uploadInformationStatusTypedCallback,
+                handler->_uploadInformationStatusTypedContext);
+        }
+        if (callback != nullptr || slot->statusCallback != nullptr)
+        {
+            register_upload_information_status_callback(slot->handler,
+                                                        uploadBatchStatusCbk,
+                                                        slot);
+        }
+    }
+
+    for (size_t i = 0; i < jobs_size; ++i)
+    {
+        jobs[i].result = COMMUNICATION_OPERATION_ERROR;
+    }
+    queuedBatchJobs += jobs_size;
+
+    size_t nextJob = 0;
+    size_t running = 0;
+    std::vector<struct pollfd> pollFds(slotsSize);
+    do
+    {
+        // Fill idle slots with pending jobs
+        for (size_t i = 0; i < slotsSize && nextJob < jobs_size; ++i)
+        {
+            if (slots[i].operation != NULL)
+            {
+                continue;
+            }
+            while (nextJob < jobs_size)
+            {
+                size_t jobIndex = nextJob++;
+                queuedBatchJobs--;
+                if (startUploadBatchJob(&slots[i], jobIndex) == COMMUNICATION_OPERATION_OK)
+                {
+                    ++running;
+                    break;
+                }
+                slots[i].operation = NULL;
+            }
+        }
+
+        if (running == 0)
+        {
+            break;
+        }
+
+        for (size_t i = 0; i < slotsSize; ++i)
+        {
+            pollFds[i].fd = -1;
+            pollFds[i].events = POLLIN;
+            pollFds[i].revents = 0;
+            if (slots[i].operation != NULL)
+            {
+                upload_async_get_fd(slots[i].operation, &pollFds[i].fd);
+            }
+        }
+        if (poll(pollFds.data(), pollFds.size(), -1) < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        // Collect finished jobs
+        for (size_t i = 0; i < slotsSize; ++i)
+        {
+            if (slots[i].operation == NULL)
+            {
+                continue;
+            }
+            AsyncUploadState state = ASYNC_UPLOAD_RUNNING;
+            CommunicationOperationResult result = COMMUNICATION_OPERATION_ERROR;
+            upload_async_poll(slots[i].operation, &state, &result);
+            if (state == ASYNC_UPLOAD_FINISHED)
+            {
+                jobs[slots[i].jobIndex].result = result;
+                upload_async_release(&slots[i].operation);
+                --running;
+            }
+        }
+    } while (running > 0 || nextJob < jobs_size);
+    queuedBatchJobs -= jobs_size - nextJob;
+
+    // If waiting failed, uploads still running finish anyway, take their
+    // results as well.
+    for (size_t i = 0; i < slotsSize; ++i)
+    {
+        if (slots[i].operation != NULL)
+        {
+            AsyncUploadState state = ASYNC_UPLOAD_RUNNING;
+            CommunicationOperationResult result = COMMUNICATION_OPERATION_ERROR;
+            upload_async_wait(slots[i].operation, -1, &state, &result);
+            jobs[slots[i].jobIndex].result = result;
+            upload_async_release(&slots[i].operation);
+        }
+        destroy_handler(&slots[i].handler);
+    }
+
+    size_t failed = 0;
+    for (size_t i = 0; i < jobs_size; ++i)
+    {
+        if (jobs[i].result != COMMUNICATION_OPERATION_OK)
+        {
+            ++failed;
+        }
+    }
+    if (failed_jobs != NULL)
+    {
+        *failed_jobs = failed;
+    }
+
+    return failed == 0 ? COMMUNICATION_OPERATION_OK : COMMUNICATION_OPERATION_ERROR;
+}
+
+static std::string renderMetrics()
+{
+    HandlerStats stats;
+    uint64_t handlerCount = 0;
+    {
+        std::lock_guard<std::mutex> retiredLock(retiredStatsMutex);
+        stats = retiredStats;
+        handlers.forEach([&stats, &handlerCount](struct CommunicationHandler *handler)
+                         {
+            std::lock_guard<std::mutex> lock(handler->_statsMutex);
+            Statistics::merge(&stats, handler->_stats);
+            handlerCount++; });
+    }
+
+    MetricsText text;
+    text.gauge("handlers", "Communication handlers.", handlerCount);
+    text.gauge("uploads_active", "Uploads running, including the ones waiting for a retry.",
+               activeUploads);
+    text.gauge("async_uploads_queued", "Asynchronous uploads queued for a shared worker.",
+               asyncUploadPool.queued());
+    text.gauge("batch_jobs_queued", "Batch upload jobs not started yet.",
+               queuedBatchJobs);
+    text.counter("uploads", "Uploads finished.", stats.uploads);
+    text.counter("upload_failures", "Uploads failed.", stats.uploadFailures);
+    text.counter("authentications", "Authentication attempts.", stats.authentications);
+    text.counter("authentication_failures", "Authentication attempts failed.",
+                 stats.authenticationFailures);
+    text.counter("upload_retries", "Upload attempts retried.", stats.retries);
+    text.counter("sent_bytes", "Bytes of the loads transferred successfully.",
+                 stats.bytesSent);
+    text.counter("status_messages", "Status messages received.", stats.statusMessages);
+    text.histogram("upload_duration_seconds", "Upload duration, including retries.",
+                   stats.uploadLatency);
+    text.histogram("authentication_duration_seconds", "Authentication attempt duration.",
+                   stats.authenticationLatency);
+    text.histogram("encryption_duration_seconds", "Certificate encryption duration.",
+                   stats.encryptionLatency);
+    text.histogram("initialization_duration_seconds",
+                   "Time from the start of a transfer to the initialization response.",
+                   stats.initializationLatency);
+    text.histogram("transfer_duration_seconds", "Transfer attempt duration.",
+                   stats.transferLatency);
+    text.histogram("status_interval_seconds", "Time between status messages.",
+                   stats.statusInterval);
+    text.histogram("callback_duration_seconds", "Time spent in application callbacks.",
+                   stats.callbackLatency);
+    return text.finish();
+}
+
+CommunicationOperationResult get_metrics_text(char *buffer, size_t *buffer_size)
+{
+    if (buffer_size == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+
+    std::string text = renderMetrics();
+    size_t capacity = *buffer_size;
+    *buffer_size = text.size() + 1;
+    if (buffer == NULL || capacity < text.size() + 1)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    memcpy(buffer, text.c_str(), text.size() + 1);
+    return COMMUNICATION_OPERATION_OK;
+}
+
+static MetricsServer metricsServer;
+
+CommunicationOperationResult start_metrics_server(unsigned short port,
+                                                  unsigned short *bound_port)
+{
+    if (!metricsServer.start(port, METRICS_CONTENT_TYPE, renderMetrics))
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+    if (bound_port != NULL)
+    {
+        *bound_port = metricsServer.getPort();
+    }
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult stop_metrics_server()
+{
+    metricsServer.stop();
+    return COMMUNICATION_OPERATION_OK;
+}
+
+CommunicationOperationResult dump_trace(const char *path)
+{
+#ifdef COMMUNICATION_MANAGER_TRACE
+    if (path != NULL && Trace::dump(path))
+    {
+        return COMMUNICATION_OPERATION_OK;
+    }
+#else
+    (void)path;
+#endif
+    return COMMUNICATION_OPERATION_ERROR;
+}
+
+CommunicationOperationResult get_trace_enabled(int *enabled)
+{
+    if (enabled == NULL)
+    {
+        return COMMUNICATION_OPERATION_ERROR;
+    }
+#ifdef COMMUNICATION_MANAGER_TRACE
+    *enabled = 1;
+#else
+    *enabled = 0;
+#endif
+    return COMMUNICATION_OPERATION_OK;
+}
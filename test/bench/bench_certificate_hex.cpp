@@ -0,0 +1,92 @@
+#include <chrono>
+#include <stdio.h>
+#include <string>
+
+#include "AuthenticationManager.h"
+
+/*
+ * Micro-benchmark of the certificate reader used before encryption, against
+ * the byte at a time reader it replaced. Run from the test directory:
+ *
+ *     make benchmarks && ./bin/benchmark_communication_manager
+ */
+
+#define BENCH_MIN_TIME_MS 500
+
+// Reader replaced by AuthenticationManager::readHexContent, kept as found,
+// including the duplicated last byte.
+static bool readHexContentByteByByte(FILE *fp, std::string &hexContent)
+{
+    hexContent.clear();
+    fseek(fp, 0, SEEK_SET);
+    while (!feof(fp))
+    {
+        char hexChar[3];
+        unsigned char byte;
+        if (fread(&byte, 1, 1, fp) != 1)
+        {
+            // The last byte read is encoded again
+        }
+        sprintf(hexChar, "%02X", byte);
+        hexContent += hexChar;
+    }
+    return true;
+}
+
+typedef bool (*HexReader)(FILE *fp, std::string &hexContent);
+
+// Average time of a read, in milliseconds.
+static double measure(FILE *fp, HexReader reader, std::string &hexContent)
+{
+    size_t iterations = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::steady_clock::duration::zero();
+    do
+    {
+        if (!reader(fp, hexContent))
+        {
+            return -1;
+        }
+        iterations++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(BENCH_MIN_TIME_MS));
+
+    return std::chrono::duration<double, std::milli>(elapsed).count() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    const char *defaultFiles[] = {"pesca.pem", "00000004_20000036.bin"};
+    const char **files = argc > 1 ? (const char **)argv + 1 : defaultFiles;
+    int filesSize = argc > 1 ? argc - 1 : 2;
+
+    printf("%-28s %12s %12s %12s %8s\n", "file", "size", "byte (ms)", "bulk (ms)",
+           "speedup");
+    for (int i = 0; i < filesSize; ++i)
+    {
+        FILE *fp = fopen(files[i], "rb");
+        if (fp == NULL)
+        {
+            fprintf(stderr, "Can't open %s\n", files[i]);
+            return 1;
+        }
+
+        std::string byteHex;
+        std::string bulkHex;
+        double byteMs = measure(fp, readHexContentByteByByte, byteHex);
+        double bulkMs = measure(fp, AuthenticationManager::readHexContent, bulkHex);
+        fclose(fp);
+
+        // Apart from the duplicated last byte, the output must not change.
+        if (byteMs < 0 || bulkMs < 0 ||
+            byteHex.compare(0, bulkHex.size(), bulkHex) != 0)
+        {
+            fprintf(stderr, "Output of %s differs\n", files[i]);
+            return 1;
+        }
+
+        printf("%-28s %12zu %12.3f %12.3f %7.1fx\n", files[i], bulkHex.size() / 2,
+               byteMs, bulkMs, byteMs / bulkMs);
+    }
+    return 0;
+}
@@ -11,6 +11,7 @@ CXXFLAGS 		+= -Wextra
 CXXFLAGS		+= -pthread
 CXXFLAGS 		+= -fprofile-arcs -ftest-coverage --coverage
 COBJFLAGS 		:= $(CXXFLAGS) -c
+BENCHFLAGS 		:= -O2 -Wall -Wextra -pthread -std=c++11
 LDFLAGS  		:= -L$(DEP_PATH)/lib
 LDLIBS   		:= -lcommunicationmanager -larinc615a -ltransfer -ltftp -ltftpd -lblsecurity 
 LDLIBS 			+= -lgcrypt -lgpg-error -lgtest -lgcov -lpthread -lcjson
@@ -18,4 +19,6 @@ INCFLAGS 		:= -I$(DEP_PATH)/include
 
 debug: COBJFLAGS 		+= $(DBGFLAGS)
 debugdeps: DEP_RULE    	:= debug
-testdeps: DEP_RULE    	:= test
\ No newline at end of file
+testdeps: DEP_RULE    	:= test
+tracedeps: DEP_RULE    	:= trace
+benchdeps: DEP_RULE    	:= release
\ No newline at end of file
@@ -92,4 +92,48 @@ TEST_F(CommunicationManagerAuthenticationTest, AuthenticationFail)
     authenticator->setCertificate(certificate);
 
     ASSERT_EQ(authenticator->authenticate(), COMMUNICATION_OPERATION_ERROR);
-}
\ No newline at end of file
+}
+
+TEST_F(CommunicationManagerAuthenticationTest, AuthenticationSessionCached)
+{
+    startBLModule();
+
+    configTargetHardware();
+    setCertificate();
+
+    ASSERT_EQ(authenticator->setSessionTtl(60), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(authenticator->authenticate(), COMMUNICATION_OPERATION_OK);
+
+    // Stop the B/L module, the session must be reused without a handshake
+    kill(blModulePid, SIGINT);
+    waitpid(blModulePid, NULL, 0);
+    blModulePid = 0;
+
+    ASSERT_EQ(authenticator->authenticate(), COMMUNICATION_OPERATION_OK);
+
+    ASSERT_EQ(authenticator->invalidateSession(), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(authenticator->authenticate(), COMMUNICATION_OPERATION_ERROR);
+}
+
+TEST_F(CommunicationManagerAuthenticationTest, AuthenticationParallelEncryption)
+{
+    startBLModule();
+
+    configTargetHardware();
+    setCertificate();
+
+    ASSERT_EQ(authenticator->setEncryptionWorkers(0), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(authenticator->authenticate(), COMMUNICATION_OPERATION_OK);
+}
+
+TEST_F(CommunicationManagerAuthenticationTest, AuthenticationCiphertextFormatFallback)
+{
+    startBLModule();
+
+    configTargetHardware();
+    setCertificate();
+
+    // The B/L module doesn't list compact formats, so advanced must be used
+    ASSERT_EQ(authenticator->setCiphertextFormat(CIPHERTEXT_FORMAT_RAW), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(authenticator->authenticate(), COMMUNICATION_OPERATION_OK);
+}
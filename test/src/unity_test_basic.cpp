@@ -2,6 +2,15 @@
 
 #include "icommunicationmanager.h"
 
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
 class CommunicationManagerBasicTest : public ::testing::Test
 {
 protected:
@@ -104,4 +113,157 @@ TEST_F(CommunicationManagerBasicTest, RegisterUploadFileNotAvailableCallback)
     void *context = nullptr;
     CommunicationOperationResult result = register_file_not_available_callback(handler, callback, context);
     ASSERT_EQ(result, COMMUNICATION_OPERATION_OK);
-}
\ No newline at end of file
+}
+
+TEST_F(CommunicationManagerBasicTest, HandlerIdLookup)
+{
+    uint64_t id = 0;
+    ASSERT_EQ(get_handler_id(handler, &id), COMMUNICATION_OPERATION_OK);
+    ASSERT_NE(id, 0);
+
+    CommunicationHandlerPtr found = nullptr;
+    ASSERT_EQ(get_handler_by_id(id, &found), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(found, handler);
+    ASSERT_EQ(release_handler(found), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(release_handler(found), COMMUNICATION_OPERATION_ERROR);
+
+    // Handlers created in the same second must not collide
+    CommunicationHandlerPtr other = nullptr;
+    uint64_t otherId = 0;
+    ASSERT_EQ(create_handler(&other), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(get_handler_id(other, &otherId), COMMUNICATION_OPERATION_OK);
+    ASSERT_NE(otherId, id);
+
+    // Destroyed handlers can't be found nor destroyed again
+    CommunicationHandlerPtr stale = other;
+    ASSERT_EQ(destroy_handler(&other), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(get_handler_by_id(otherId, &found), COMMUNICATION_OPERATION_ERROR);
+    ASSERT_EQ(found, nullptr);
+    ASSERT_EQ(destroy_handler(&stale), COMMUNICATION_OPERATION_ERROR);
+
+    // The slot may be reused, but never with the same id
+    ASSERT_EQ(create_handler(&other), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(get_handler_by_id(otherId, &found), COMMUNICATION_OPERATION_ERROR);
+    ASSERT_EQ(destroy_handler(&other), COMMUNICATION_OPERATION_OK);
+}
+
+TEST_F(CommunicationManagerBasicTest, ConcurrentHandlerCreation)
+{
+    const int threadsSize = 8;
+    const int handlersPerThread = 16;
+    std::vector<std::thread> threads;
+    std::vector<uint64_t> ids[threadsSize];
+
+    for (int i = 0; i < threadsSize; ++i)
+    {
+        threads.push_back(std::thread([&ids, i, handlersPerThread]()
+                                      {
+            for (int j = 0; j < handlersPerThread; ++j)
+            {
+                CommunicationHandlerPtr threadHandler = nullptr;
+                uint64_t id = 0;
+                create_handler(&threadHandler);
+                get_handler_id(threadHandler, &id);
+                ids[i].push_back(id);
+                destroy_handler(&threadHandler);
+            } }));
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    std::set<uint64_t> uniqueIds;
+    for (int i = 0; i < threadsSize; ++i)
+    {
+        uniqueIds.insert(ids[i].begin(), ids[i].end());
+    }
+    ASSERT_EQ(uniqueIds.size(), threadsSize * handlersPerThread);
+}
+
+TEST_F(CommunicationManagerBasicTest, EditLoadList)
+{
+    Load load;
+    strcpy(load.loadName, "images/00000001_56.bin");
+    strcpy(load.partNumber, "00000001");
+
+    ASSERT_EQ(add_load(handler, &load), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(remove_load(handler, "images/00000001_56.bin"), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(remove_load(handler, "images/00000001_56.bin"), COMMUNICATION_OPERATION_ERROR);
+    ASSERT_EQ(clear_load_list(handler), COMMUNICATION_OPERATION_OK);
+
+    // Loads without name and missing lists are rejected
+    Load invalidLoad;
+    invalidLoad.loadName[0] = '\0';
+    invalidLoad.partNumber[0] = '\0';
+    ASSERT_EQ(add_load(handler, &invalidLoad), COMMUNICATION_OPERATION_ERROR);
+    ASSERT_EQ(set_load_list(handler, nullptr, 1), COMMUNICATION_OPERATION_ERROR);
+}
+
+TEST_F(CommunicationManagerBasicTest, DataLoaderServerPort)
+{
+    unsigned short port = 0;
+    ASSERT_EQ(set_tftp_dataloader_server_port(handler, 5959), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(get_tftp_dataloader_server_port(handler, &port), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(port, 5959);
+
+    // Automatic ports are only allocated while an upload is running
+    ASSERT_EQ(set_tftp_dataloader_server_port(handler, TFTP_DATALOADER_SERVER_PORT_AUTO),
+              COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(get_tftp_dataloader_server_port(handler, &port), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(port, TFTP_DATALOADER_SERVER_PORT_AUTO);
+
+    ASSERT_EQ(set_tftp_dataloader_port_range(0, 100), COMMUNICATION_OPERATION_ERROR);
+    ASSERT_EQ(set_tftp_dataloader_port_range(6000, 5999), COMMUNICATION_OPERATION_ERROR);
+    ASSERT_EQ(set_tftp_dataloader_port_range(TFTP_DATALOADER_PORT_RANGE_FIRST,
+                                             TFTP_DATALOADER_PORT_RANGE_LAST),
+              COMMUNICATION_OPERATION_OK);
+}
+
+TEST_F(CommunicationManagerBasicTest, MetricsText)
+{
+    size_t size = 0;
+    ASSERT_EQ(get_metrics_text(NULL, &size), COMMUNICATION_OPERATION_ERROR);
+    ASSERT_GT(size, 0);
+
+    std::vector<char> buffer(size);
+    ASSERT_EQ(get_metrics_text(buffer.data(), &size), COMMUNICATION_OPERATION_OK);
+    std::string text(buffer.data());
+    ASSERT_NE(text.find("arinc615a_handlers "), std::string::npos);
+    ASSERT_NE(text.find("arinc615a_uploads_total "), std::string::npos);
+    ASSERT_NE(text.find("arinc615a_upload_duration_seconds_bucket{le=\"+Inf\"} "),
+              std::string::npos);
+    ASSERT_EQ(text.compare(text.size() - 6, 6, "# EOF\n"), 0);
+}
+
+TEST_F(CommunicationManagerBasicTest, MetricsServer)
+{
+    unsigned short port = 0;
+    ASSERT_EQ(start_metrics_server(0, &port), COMMUNICATION_OPERATION_OK);
+    ASSERT_NE(port, 0);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    ASSERT_EQ(connect(fd, (struct sockaddr *)&address, sizeof(address)), 0);
+
+    std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+    ASSERT_EQ(write(fd, request.data(), request.size()), (ssize_t)request.size());
+    std::string response;
+    char buffer[1024];
+    ssize_t received;
+    while ((received = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        response.append(buffer, received);
+    }
+    close(fd);
+
+    ASSERT_EQ(response.compare(0, 15, "HTTP/1.0 200 OK"), 0);
+    ASSERT_NE(response.find("application/openmetrics-text"), std::string::npos);
+    ASSERT_NE(response.find("# EOF\n"), std::string::npos);
+
+    ASSERT_EQ(stop_metrics_server(), COMMUNICATION_OPERATION_OK);
+}
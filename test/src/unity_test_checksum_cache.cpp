@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include "ChecksumCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define IMAGE_PATH "images/checksum_cache_test.bin"
+
+class CommunicationManagerChecksumCacheTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        writeImage("0123456789");
+    }
+
+    void TearDown() override
+    {
+        unlink(IMAGE_PATH);
+    }
+
+    void writeImage(const char *content)
+    {
+        FILE *fp = fopen(IMAGE_PATH, "wb");
+        ASSERT_NE(fp, nullptr);
+        fwrite(content, 1, strlen(content), fp);
+        fclose(fp);
+    }
+};
+
+TEST_F(CommunicationManagerChecksumCacheTest, ChecksumsAreShared)
+{
+    uint32_t crc32 = 0;
+    ASSERT_TRUE(ChecksumCache::getInstance().getChecksums(IMAGE_PATH, &crc32, NULL));
+    size_t cached = ChecksumCache::getInstance().size();
+
+    uint32_t sameCrc32 = 0;
+    ASSERT_TRUE(ChecksumCache::getInstance().getChecksums(IMAGE_PATH, &sameCrc32, NULL));
+    ASSERT_EQ(crc32, sameCrc32);
+    ASSERT_EQ(ChecksumCache::getInstance().size(), cached);
+}
+
+TEST_F(CommunicationManagerChecksumCacheTest, ChangedImageIsChecksummedAgain)
+{
+    uint32_t crc32 = 0;
+    ASSERT_TRUE(ChecksumCache::getInstance().getChecksums(IMAGE_PATH, &crc32, NULL));
+
+    writeImage("01234567890123456789");
+
+    uint32_t newCrc32 = 0;
+    ASSERT_TRUE(ChecksumCache::getInstance().getChecksums(IMAGE_PATH, &newCrc32, NULL));
+    ASSERT_NE(crc32, newCrc32);
+}
+
+TEST_F(CommunicationManagerChecksumCacheTest, MissingImage)
+{
+    ASSERT_FALSE(ChecksumCache::getInstance().getChecksums("images/missing.bin", NULL, NULL));
+}
+
+TEST_F(CommunicationManagerChecksumCacheTest, ImageChecksums)
+{
+    uint32_t crc32 = 0;
+    unsigned char sha256[SHA256_SIZE];
+    ASSERT_TRUE(ChecksumCache::getInstance().getChecksums(IMAGE_PATH, &crc32, sha256));
+    ASSERT_EQ(crc32, 0xA684C7C6);
+    ASSERT_EQ(sha256[0], 0x84);
+    ASSERT_EQ(sha256[1], 0xd8);
+}
+
+TEST_F(CommunicationManagerChecksumCacheTest, CancelledChecksums)
+{
+    // A new size, so nothing is cached for this version of the file
+    writeImage("01234567890");
+
+    std::atomic<bool> cancel(true);
+    ASSERT_FALSE(ChecksumCache::getInstance().getChecksums(IMAGE_PATH, NULL, NULL, &cancel));
+
+    // A cancelled computation is started again by the next call
+    uint32_t crc32 = 0;
+    ASSERT_TRUE(ChecksumCache::getInstance().getChecksums(IMAGE_PATH, &crc32, NULL));
+    ASSERT_EQ(crc32, 0x867A3C63);
+}
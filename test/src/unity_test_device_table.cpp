@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include "DeviceTable.h"
+
+#include <unistd.h>
+
+#define DEVICE_TABLE_PATH "devices_test.json"
+
+#define DEVICE_JSON(ip) "{\"mac\":\"9A-DA-C1-D7-51-D7\",\"ip\":\"" ip "\","     \
+                        "\"hardware\":{\"targetHardwareIdentifier\":\"HNPFMS\"," \
+                        "\"targetTypeName\":\"FMS\",\"targetPosition\":\"L\","   \
+                        "\"literalName\":\"FMS LEFT\",\"manufacturerCode\":\"HNP\"}}"
+
+class CommunicationManagerDeviceTableTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        DeviceTable::getInstance().setPersistencePath("");
+        DeviceTable::getInstance().clear();
+        unlink(DEVICE_TABLE_PATH);
+    }
+
+    void TearDown() override
+    {
+        DeviceTable::getInstance().setPersistencePath("");
+        DeviceTable::getInstance().clear();
+        unlink(DEVICE_TABLE_PATH);
+    }
+};
+
+TEST_F(CommunicationManagerDeviceTableTest, UpdateReportsChanges)
+{
+    DeviceTable &table = DeviceTable::getInstance();
+    ASSERT_EQ(table.update(DEVICE_JSON("127.0.0.1"), 100), DeviceTable::DEVICE_NEW);
+    ASSERT_EQ(table.update(DEVICE_JSON("127.0.0.1"), 200), DeviceTable::DEVICE_UNCHANGED);
+    ASSERT_EQ(table.update(DEVICE_JSON("127.0.0.2"), 300), DeviceTable::DEVICE_CHANGED);
+    ASSERT_EQ(table.update("{\"ip\":\"127.0.0.1\"}", 400), DeviceTable::DEVICE_INVALID);
+    ASSERT_EQ(table.list().size(), 1);
+
+    DeviceTable::Device device;
+    ASSERT_TRUE(table.lookup("HNPFMS", "L", device));
+    ASSERT_EQ(device.ip, "127.0.0.2");
+    ASSERT_EQ(device.lastSeen, 300);
+    ASSERT_FALSE(table.lookup("HNPFMS", "R", device));
+}
+
+TEST_F(CommunicationManagerDeviceTableTest, TableIsPersisted)
+{
+    DeviceTable &table = DeviceTable::getInstance();
+    ASSERT_TRUE(table.setPersistencePath(DEVICE_TABLE_PATH));
+    ASSERT_EQ(table.update(DEVICE_JSON("127.0.0.1"), 100), DeviceTable::DEVICE_NEW);
+    ASSERT_TRUE(table.flush());
+    ASSERT_EQ(access(DEVICE_TABLE_PATH, F_OK), 0);
+
+    // Forget the devices in memory only, then load them back
+    table.setPersistencePath("");
+    table.clear();
+    ASSERT_EQ(table.list().size(), 0);
+    ASSERT_TRUE(table.setPersistencePath(DEVICE_TABLE_PATH));
+
+    DeviceTable::Device device;
+    ASSERT_TRUE(table.lookup("HNPFMS", "L", device));
+    ASSERT_EQ(device.ip, "127.0.0.1");
+    ASSERT_EQ(device.mac, "9A-DA-C1-D7-51-D7");
+    ASSERT_EQ(device.literalName, "FMS LEFT");
+    ASSERT_EQ(device.lastSeen, 100);
+}
+
+TEST_F(CommunicationManagerDeviceTableTest, OnlyChangesArePersisted)
+{
+    DeviceTable &table = DeviceTable::getInstance();
+    ASSERT_TRUE(table.setPersistencePath(DEVICE_TABLE_PATH));
+    ASSERT_EQ(table.update(DEVICE_JSON("127.0.0.1"), 100), DeviceTable::DEVICE_NEW);
+    ASSERT_TRUE(table.flush());
+    unlink(DEVICE_TABLE_PATH);
+
+    // Seeing the same device again doesn't write the file
+    ASSERT_EQ(table.update(DEVICE_JSON("127.0.0.1"), 200), DeviceTable::DEVICE_UNCHANGED);
+    ASSERT_TRUE(table.flush());
+    ASSERT_NE(access(DEVICE_TABLE_PATH, F_OK), 0);
+
+    ASSERT_EQ(table.update(DEVICE_JSON("127.0.0.2"), 300), DeviceTable::DEVICE_CHANGED);
+    ASSERT_TRUE(table.flush());
+    ASSERT_EQ(access(DEVICE_TABLE_PATH, F_OK), 0);
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <fstream>
+#include <vector>
 
 #include "icommunicationmanager.h"
 
@@ -79,4 +80,98 @@ TEST_F(CommunicationManagerFindTest, FindDeviceTest)
     if (deviceInfo != nullptr) {
         delete deviceInfo;
     }
-}
\ No newline at end of file
+}
+
+TEST_F(CommunicationManagerFindTest, FindUpdatesDeviceCache)
+{
+    int devicesReported = 0;
+    createFindStub();
+    find_new_device callback = [](CommunicationHandlerPtr handler,
+                                  const char *device,
+                                  void *context)
+    {
+        (*(int *)context)++;
+        return COMMUNICATION_OPERATION_OK;
+    };
+    ASSERT_EQ(clear_device_cache(), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(register_find_new_device_callback(handler, callback, &devicesReported),
+              COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(set_find_report_changes_only(handler, 1), COMMUNICATION_OPERATION_OK);
+
+    ASSERT_EQ(find(handler), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(devicesReported, 1);
+
+    DiscoveredDevice device;
+    ASSERT_EQ(get_cached_device("HNPFMS", "L", &device), COMMUNICATION_OPERATION_OK);
+    ASSERT_STREQ(device.ip, "127.0.0.1");
+    ASSERT_EQ(set_target_hardware_from_cache(handler, "HNPFMS", "L"), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(set_target_hardware_from_cache(handler, "HNPFMS", "R"), COMMUNICATION_OPERATION_ERROR);
+
+    // Nothing changed, so the device isn't reported again
+    ASSERT_EQ(find(handler), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(devicesReported, 1);
+}
+
+TEST_F(CommunicationManagerFindTest, FindWithDeadline)
+{
+    int finishedCalls = 0;
+    std::string *deviceInfo = nullptr;
+    createFindStub();
+    find_new_device newDeviceCallback = [](CommunicationHandlerPtr handler,
+                                           const char *device,
+                                           void *context)
+    {
+        std::string **deviceInfo = (std::string **)context;
+        *deviceInfo = new std::string(device);
+        return COMMUNICATION_OPERATION_OK;
+    };
+    find_finished finishedCallback = [](CommunicationHandlerPtr handler,
+                                        void *context)
+    {
+        (*(int *)context)++;
+        return COMMUNICATION_OPERATION_OK;
+    };
+    register_find_new_device_callback(handler, newDeviceCallback, &deviceInfo);
+    register_find_finished_callback(handler, finishedCallback, &finishedCalls);
+
+    ASSERT_EQ(find_with_deadline(handler, 5000), COMMUNICATION_OPERATION_OK);
+    ASSERT_NE(deviceInfo, nullptr);
+    ASSERT_STREQ(deviceInfo->c_str(), DEVICE_INFO);
+    ASSERT_EQ(finishedCalls, 1);
+    delete deviceInfo;
+    deviceInfo = nullptr;
+
+    // The find is over, a new one can start right away
+    ASSERT_EQ(find(handler), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(finishedCalls, 2);
+
+    delete deviceInfo;
+}
+
+TEST_F(CommunicationManagerFindTest, FindDevicesInBatches)
+{
+    std::vector<std::string> devicesFound;
+    createFindStub();
+    find_new_devices_batch_callback callback = [](CommunicationHandlerPtr handler,
+                                                  const DiscoveredDevice *devices,
+                                                  size_t devices_size,
+                                                  void *context)
+    {
+        std::vector<std::string> *devicesFound = (std::vector<std::string> *)context;
+        for (size_t i = 0; i < devices_size; ++i)
+        {
+            devicesFound->push_back(std::string(devices[i].targetHardwareId) + "/" +
+                                    devices[i].targetPosition + "@" + devices[i].ip);
+        }
+        return COMMUNICATION_OPERATION_OK;
+    };
+    ASSERT_EQ(register_find_new_devices_batch_callback(handler, callback, &devicesFound, 0, 0),
+              COMMUNICATION_OPERATION_ERROR);
+    ASSERT_EQ(register_find_new_devices_batch_callback(handler, callback, &devicesFound, 16, 100),
+              COMMUNICATION_OPERATION_OK);
+
+    // The only device is delivered when the find finishes
+    ASSERT_EQ(find(handler), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(devicesFound.size(), 1);
+    ASSERT_EQ(devicesFound[0], "HNPFMS/L@127.0.0.1");
+}
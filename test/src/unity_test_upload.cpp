@@ -4,6 +4,9 @@
 #include "InitializationFileARINC615A.h"
 #include "LoadUploadStatusFileARINC615A.h"
 #include <cjson/cJSON.h>
+#include <poll.h>
+#include <chrono>
+#include <thread>
 
 #define DATALOADER_SERVER_PORT 5959
 #define TARGETHARDWARE_SERVER_PORT 59595
@@ -265,6 +268,46 @@ TEST_F(CommunicationManagerUploadTest, UploadFailNoAuthentication)
     ASSERT_FALSE(uploadSuccess);
 }
 
+TEST_F(CommunicationManagerUploadTest, UploadRetryAuthenticationWithBackoff)
+{
+    startBLModule();
+
+    configTargetHardware();
+    setLoadList();
+
+    // Do not set certificate so every authentication attempt fails
+    // setCertificate();
+
+    UploadRetryPolicy policy = {};
+    policy.maxAuthenticationAttempts = 3;
+    policy.initialBackoffMs = 50;
+    policy.maxBackoffMs = 1000;
+    policy.backoffMultiplier = 2;
+    policy.jitterPercent = 0;
+    ASSERT_EQ(set_upload_retry_policy(handler, &policy), COMMUNICATION_OPERATION_OK);
+
+    // Waits 50ms after the first failure and 100ms after the second one
+    auto start = std::chrono::steady_clock::now();
+    CommunicationOperationResult result = upload(handler);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(result, COMMUNICATION_OPERATION_ERROR);
+    ASSERT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 150);
+
+    // Without a cap the backoff keeps growing: 50ms, then 200ms
+    policy.maxBackoffMs = 0;
+    policy.backoffMultiplier = 4;
+    ASSERT_EQ(set_upload_retry_policy(handler, &policy), COMMUNICATION_OPERATION_OK);
+    start = std::chrono::steady_clock::now();
+    result = upload(handler);
+    elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_EQ(result, COMMUNICATION_OPERATION_ERROR);
+    ASSERT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 250);
+
+    policy.retryableStatusCodesSize = MAX_RETRYABLE_STATUS_CODES + 1;
+    ASSERT_EQ(set_upload_retry_policy(handler, &policy), COMMUNICATION_OPERATION_ERROR);
+    ASSERT_EQ(set_upload_retry_policy(handler, NULL), COMMUNICATION_OPERATION_OK);
+}
+
 TEST_F(CommunicationManagerUploadTest, UploadFailTransmissionError)
 {
     bool uploadAbortedByTargetHardware = false;
@@ -363,4 +406,374 @@ TEST_F(CommunicationManagerUploadTest, UploadAbortedByOperator)
 
     ASSERT_EQ(COMMUNICATION_OPERATION_ERROR, upload(handler));
     ASSERT_TRUE(uploadAbortedByOperator);
-}
\ No newline at end of file
+}
+
+TEST_F(CommunicationManagerUploadTest, UploadSuccessTypedStatus)
+{
+    bool uploadSuccess = false;
+    startBLModule();
+
+    upload_information_status_typed_callback callback = [](CommunicationHandlerPtr handler,
+                                                           const UploadInformationStatus *status,
+                                                           void *context) -> CommunicationOperationResult
+    {
+        bool *uploadSuccess = (bool *)context;
+        *uploadSuccess = status->uploadOperationStatusCode == STATUS_UPLOAD_COMPLETED;
+        return COMMUNICATION_OPERATION_OK;
+    };
+
+    register_upload_information_status_typed_callback(handler, callback, &uploadSuccess);
+
+    configTargetHardware();
+    setLoadList();
+    setCertificate();
+
+    CommunicationOperationResult result = upload(handler);
+    ASSERT_EQ(result, COMMUNICATION_OPERATION_OK);
+    ASSERT_TRUE(uploadSuccess);
+}
+
+TEST_F(CommunicationManagerUploadTest, ResumeUpload)
+{
+    startBLModule();
+
+    configTargetHardware();
+    setLoadList();
+    setCertificate();
+
+    // Nothing to resume from without checkpointing
+    ASSERT_EQ(resume_upload(handler), COMMUNICATION_OPERATION_ERROR);
+
+    ASSERT_EQ(set_upload_checkpoint(handler, 1), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(upload(handler), COMMUNICATION_OPERATION_OK);
+
+    // Every load was confirmed, so resuming has nothing left to transmit
+    ASSERT_EQ(resume_upload(handler), COMMUNICATION_OPERATION_OK);
+
+    // The full load list is used again by the next upload
+    ASSERT_EQ(upload(handler), COMMUNICATION_OPERATION_OK);
+}
+
+TEST_F(CommunicationManagerUploadTest, UploadStats)
+{
+    startBLModule();
+
+    upload_information_status_callback callback = [](CommunicationHandlerPtr handler,
+                                                     const char *upload_information_status_json,
+                                                     void *context) -> CommunicationOperationResult
+    {
+        return COMMUNICATION_OPERATION_OK;
+    };
+    register_upload_information_status_callback(handler, callback, nullptr);
+
+    configTargetHardware();
+    setLoadList();
+    setCertificate();
+
+    ASSERT_EQ(upload(handler), COMMUNICATION_OPERATION_OK);
+
+    HandlerStats stats;
+    ASSERT_EQ(get_handler_stats(handler, &stats), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(stats.uploads, 1);
+    ASSERT_EQ(stats.uploadFailures, 0);
+    ASSERT_EQ(stats.authentications, 1);
+    ASSERT_EQ(stats.authenticationFailures, 0);
+    ASSERT_GT(stats.bytesSent, 0);
+    ASSERT_GT(stats.statusMessages, 0);
+    ASSERT_EQ(stats.uploadLatency.count, 1);
+    ASSERT_EQ(stats.transferLatency.count, 1);
+    ASSERT_EQ(stats.encryptionLatency.count, 1);
+    ASSERT_EQ(stats.callbackLatency.count, stats.statusMessages);
+    ASSERT_GE(stats.uploadLatency.totalUs, stats.transferLatency.totalUs);
+
+    uint64_t bucketed = 0;
+    for (size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; ++i)
+    {
+        bucketed += stats.uploadLatency.buckets[i];
+    }
+    ASSERT_EQ(bucketed, stats.uploadLatency.count);
+
+    ASSERT_EQ(reset_handler_stats(handler), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(get_handler_stats(handler, &stats), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(stats.uploads, 0);
+    ASSERT_EQ(stats.bytesSent, 0);
+    ASSERT_EQ(stats.uploadLatency.count, 0);
+}
+
+TEST_F(CommunicationManagerUploadTest, UploadTrace)
+{
+    startBLModule();
+
+    configTargetHardware();
+    setLoadList();
+    setCertificate();
+
+    ASSERT_EQ(upload(handler), COMMUNICATION_OPERATION_OK);
+
+    int traceEnabled = 0;
+    ASSERT_EQ(get_trace_enabled(&traceEnabled), COMMUNICATION_OPERATION_OK);
+    if (!traceEnabled)
+    {
+        // Trace points are not compiled in
+        ASSERT_EQ(dump_trace("trace.json"), COMMUNICATION_OPERATION_ERROR);
+        return;
+    }
+
+    ASSERT_EQ(dump_trace("trace.json"), COMMUNICATION_OPERATION_OK);
+
+    FILE *fp = fopen("trace.json", "r");
+    ASSERT_NE(fp, nullptr);
+    std::string trace;
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+    {
+        trace.append(buffer, read);
+    }
+    fclose(fp);
+    remove("trace.json");
+
+    cJSON *json = cJSON_Parse(trace.c_str());
+    ASSERT_NE(json, nullptr);
+    cJSON_Delete(json);
+    ASSERT_NE(trace.find("\"authenticate\""), std::string::npos);
+    ASSERT_NE(trace.find("\"transfer\""), std::string::npos);
+}
+
+TEST_F(CommunicationManagerUploadTest, UploadAsyncSuccess)
+{
+    bool uploadSuccess = false;
+    startBLModule();
+
+    upload_information_status_callback callback = [](CommunicationHandlerPtr handler,
+                                                     const char *upload_information_status_json,
+                                                     void *context) -> CommunicationOperationResult
+    {
+        cJSON *json = cJSON_Parse(upload_information_status_json);
+        if (json == nullptr)
+        {
+            return COMMUNICATION_OPERATION_ERROR;
+        }
+        cJSON *jsonOperationAcceptanceStatusCode = cJSON_GetObjectItemCaseSensitive(json, "uploadOperationStatusCode");
+        if (jsonOperationAcceptanceStatusCode == nullptr)
+        {
+            return COMMUNICATION_OPERATION_ERROR;
+        }
+        bool *uploadSuccess = (bool *)context;
+        uint16_t statusCode = jsonOperationAcceptanceStatusCode->valueint;
+        *uploadSuccess = statusCode == STATUS_UPLOAD_COMPLETED;
+        return COMMUNICATION_OPERATION_OK;
+    };
+
+    register_upload_information_status_callback(handler, callback, &uploadSuccess);
+
+    configTargetHardware();
+    setLoadList();
+    setCertificate();
+
+    AsyncUploadPtr operation = nullptr;
+    ASSERT_EQ(upload_async(handler, &operation), COMMUNICATION_OPERATION_OK);
+    ASSERT_NE(operation, nullptr);
+
+    // A second upload can't be started while the first one is running
+    AsyncUploadPtr secondOperation = nullptr;
+    ASSERT_EQ(upload_async(handler, &secondOperation), COMMUNICATION_OPERATION_ERROR);
+
+    int fd = -1;
+    ASSERT_EQ(upload_async_get_fd(operation, &fd), COMMUNICATION_OPERATION_OK);
+    struct pollfd pfd = {fd, POLLIN, 0};
+    ASSERT_EQ(poll(&pfd, 1, 60000), 1);
+
+    AsyncUploadState state = ASYNC_UPLOAD_RUNNING;
+    CommunicationOperationResult result = COMMUNICATION_OPERATION_ERROR;
+    ASSERT_EQ(upload_async_poll(operation, &state, &result), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(state, ASYNC_UPLOAD_FINISHED);
+    ASSERT_EQ(result, COMMUNICATION_OPERATION_OK);
+    ASSERT_TRUE(uploadSuccess);
+
+    ASSERT_EQ(upload_async_release(&operation), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(operation, nullptr);
+}
+
+TEST_F(CommunicationManagerUploadTest, UploadAsyncSharedWorkers)
+{
+    startBLModule();
+    ASSERT_EQ(set_async_upload_workers(1), COMMUNICATION_OPERATION_OK);
+
+    configTargetHardware();
+    setLoadList();
+    setCertificate();
+
+    AsyncUploadPtr operation = nullptr;
+    ASSERT_EQ(upload_async(handler, &operation), COMMUNICATION_OPERATION_OK);
+    ASSERT_NE(operation, nullptr);
+
+    AsyncUploadState state = ASYNC_UPLOAD_RUNNING;
+    CommunicationOperationResult result = COMMUNICATION_OPERATION_ERROR;
+    ASSERT_EQ(upload_async_wait(operation, -1, &state, &result), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(state, ASYNC_UPLOAD_FINISHED);
+    ASSERT_EQ(result, COMMUNICATION_OPERATION_OK);
+
+    ASSERT_EQ(upload_async_release(&operation), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(set_async_upload_workers(0), COMMUNICATION_OPERATION_OK);
+}
+
+TEST_F(CommunicationManagerUploadTest, UploadAsyncAbortedWhileQueued)
+{
+    startBLModule();
+    ASSERT_EQ(set_async_upload_workers(1), COMMUNICATION_OPERATION_OK);
+
+    configTargetHardware();
+    setLoadList();
+    setCertificate();
+
+    // The second upload waits for the only worker, busy with the first one
+    CommunicationHandlerPtr queuedHandler = nullptr;
+    ASSERT_EQ(create_handler(&queuedHandler), COMMUNICATION_OPERATION_OK);
+
+    AsyncUploadPtr operation = nullptr;
+    AsyncUploadPtr queuedOperation = nullptr;
+    ASSERT_EQ(upload_async(handler, &operation), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(upload_async(queuedHandler, &queuedOperation), COMMUNICATION_OPERATION_OK);
+    abort_upload(queuedHandler, OPERATION_ABORTED_BY_THE_OPERATOR);
+
+    AsyncUploadState state = ASYNC_UPLOAD_RUNNING;
+    CommunicationOperationResult result = COMMUNICATION_OPERATION_OK;
+    ASSERT_EQ(upload_async_wait(queuedOperation, -1, &state, &result), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(result, COMMUNICATION_OPERATION_ERROR);
+
+    // The aborted upload never tried to authenticate
+    HandlerStats stats;
+    ASSERT_EQ(get_handler_stats(queuedHandler, &stats), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(stats.authentications, 0);
+
+    ASSERT_EQ(upload_async_wait(operation, -1, &state, &result), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(result, COMMUNICATION_OPERATION_OK);
+
+    ASSERT_EQ(upload_async_release(&queuedOperation), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(upload_async_release(&operation), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(destroy_handler(&queuedHandler), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(set_async_upload_workers(0), COMMUNICATION_OPERATION_OK);
+}
+
+TEST_F(CommunicationManagerUploadTest, UploadAsyncReleasedWhileDestroyed)
+{
+    startBLModule();
+
+    for (int i = 0; i < 8; ++i)
+    {
+        CommunicationHandlerPtr uploadHandler = nullptr;
+        ASSERT_EQ(create_handler(&uploadHandler), COMMUNICATION_OPERATION_OK);
+        std::swap(handler, uploadHandler);
+        set_tftp_dataloader_server_port(handler, DATALOADER_SERVER_PORT);
+        set_tftp_targethardware_server_port(handler, TARGETHARDWARE_SERVER_PORT);
+        configTargetHardware();
+        setLoadList();
+        setCertificate();
+        std::swap(handler, uploadHandler);
+
+        AsyncUploadPtr operation = nullptr;
+        ASSERT_EQ(upload_async(uploadHandler, &operation), COMMUNICATION_OPERATION_OK);
+
+        // Either call may unlink the operation from the handler first
+        CommunicationOperationResult destroyResult = COMMUNICATION_OPERATION_ERROR;
+        std::thread destroyThread([&uploadHandler, &destroyResult]()
+                                  { destroyResult = destroy_handler(&uploadHandler); });
+        ASSERT_EQ(upload_async_release(&operation), COMMUNICATION_OPERATION_OK);
+        destroyThread.join();
+        ASSERT_EQ(destroyResult, COMMUNICATION_OPERATION_OK);
+        ASSERT_EQ(operation, nullptr);
+        ASSERT_EQ(uploadHandler, nullptr);
+    }
+}
+
+TEST_F(CommunicationManagerUploadTest, UploadBatchSuccess)
+{
+    size_t statusMessagesReceived[2] = {0, 0};
+    startBLModule();
+    setCertificate();
+
+    upload_job_status_callback callback = [](const UploadJob *job,
+                                             size_t job_index,
+                                             const char *upload_information_status_json,
+                                             void *context) -> CommunicationOperationResult
+    {
+        size_t *statusMessagesReceived = (size_t *)context;
+        statusMessagesReceived[job_index]++;
+        return COMMUNICATION_OPERATION_OK;
+    };
+
+    Load loads[2];
+    strcpy(loads[0].loadName, "images/00000001_56.bin");
+    strcpy(loads[0].partNumber, "00000001");
+    strcpy(loads[1].loadName, "images/ARQ_Compatibilidade.xml");
+    strcpy(loads[1].partNumber, "00000000");
+
+    // The template's typed callbacks are used by every job, and get the
+    // template handler
+    struct TypedStatusContext
+    {
+        CommunicationHandlerPtr handler;
+        size_t received;
+    } typedStatusContext = {handler, 0};
+    upload_information_status_typed_callback typedCallback = [](CommunicationHandlerPtr handler,
+                                                                const UploadInformationStatus *status,
+                                                                void *context) -> CommunicationOperationResult
+    {
+        TypedStatusContext *typedStatusContext = (TypedStatusContext *)context;
+        if (handler == typedStatusContext->handler)
+        {
+            typedStatusContext->received++;
+        }
+        return COMMUNICATION_OPERATION_OK;
+    };
+    ASSERT_EQ(register_upload_information_status_typed_callback(handler, typedCallback,
+                                                                &typedStatusContext),
+              COMMUNICATION_OPERATION_OK);
+
+    // The jobs target different addresses of the same B/L module, so run
+    // them one at a time
+    UploadJob jobs[2];
+    const char *targetHardwareIps[2] = {"127.0.0.1", "127.0.0.2"};
+    for (int i = 0; i < 2; ++i)
+    {
+        strcpy(jobs[i].targetHardwareId, "HNPFMS");
+        strcpy(jobs[i].targetHardwarePosition, "L");
+        strcpy(jobs[i].targetHardwareIp, targetHardwareIps[i]);
+        jobs[i].loadList = loads;
+        jobs[i].loadListSize = 2;
+    }
+
+    size_t failedJobs = 2;
+    ASSERT_EQ(upload_batch(handler, jobs, 2, 1, callback, statusMessagesReceived, &failedJobs),
+              COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(failedJobs, 0);
+    ASSERT_EQ(jobs[0].result, COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(jobs[1].result, COMMUNICATION_OPERATION_OK);
+    ASSERT_GT(statusMessagesReceived[0], 0);
+    ASSERT_GT(statusMessagesReceived[1], 0);
+    ASSERT_EQ(typedStatusContext.received,
+              statusMessagesReceived[0] + statusMessagesReceived[1]);
+}
+
+TEST_F(CommunicationManagerUploadTest, UploadBatchPortsOutOfRange)
+{
+    Load load;
+    strcpy(load.loadName, "images/00000001_56.bin");
+    strcpy(load.partNumber, "00000001");
+
+    UploadJob jobs[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        strcpy(jobs[i].targetHardwareId, "HNPFMS");
+        strcpy(jobs[i].targetHardwarePosition, "L");
+        strcpy(jobs[i].targetHardwareIp, "127.0.0.1");
+        jobs[i].loadList = &load;
+        jobs[i].loadListSize = 1;
+    }
+
+    // A second concurrent upload would need port 65536
+    ASSERT_EQ(set_tftp_dataloader_server_port(handler, 65535), COMMUNICATION_OPERATION_OK);
+    ASSERT_EQ(upload_batch(handler, jobs, 2, 2, NULL, NULL, NULL),
+              COMMUNICATION_OPERATION_ERROR);
+}